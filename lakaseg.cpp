@@ -3,16 +3,25 @@
 #include <cstdlib>
 #include <vector>
 #include <deque>
+#include <queue>
+#include <map>
 #include <algorithm>
 #include <cmath>
 #include <fstream>
 #include <limits>
 #include <csignal>
+#include <ctime>
 
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 
 // fremde Bibliotheken aus 3rd_party/ einbinden
 #include "CImg/CImg.h"
@@ -58,18 +67,295 @@ void install_signal_handler() {
 
 
 
-// Parameter, die während des Trainings oder der Inferenz verwendet werden.
-// Es ist zwar ganz ganz schlechter Stil, globale Variablen daraus zu machen,
-// aber die werden eben oft und über den ganzen Quelltext verteilt verwendet.
-unsigned char WINDOW_SIZE;
-unsigned char WINDOW_RADIUS;
-unsigned short MAX_TREE_DEPTH;
-unsigned int TESTOBJECT_TRIES;
-unsigned short FOREST_SIZE;
+// Die Parameter eines Walds, die auch in seiner JSON-Datei stehen (siehe
+// learning_parameters_json). Jeder Wald hat sein eigenes Objekt davon (siehe
+// Forest::parameters), das beim Training und Laden überall hingereicht wird,
+// wo einer der Werte gebraucht wird. Dadurch können in einem Prozess
+// mehrere Wälder mit verschiedenen Parametern gleichzeitig benutzt werden.
+class ForestParameters
+{
+
+public:
+    unsigned char window_size;
+    unsigned char window_radius;
+    unsigned short max_tree_depth;
+    unsigned int testobject_tries;
+    unsigned short forest_size;
+
+    // 0 heißt ein Wald aus Entscheidungsbäumen (Tree), 1 heißt ein Ensemble
+    // aus Farnen (Fern). In der JSON-Datei steht das als "Model type".
+    unsigned int model_type;
+
+    // der Offset-Pool mit jeweils vier Werten pro Paar (x1, y1, x2, y2);
+    // leer, wenn ohne Pool trainiert wurde (siehe
+    // PixelDifferenceTest::draw_offset_pool)
+    std::vector<short> offset_pool;
+
+    // woher die Bäume kommen: wenn has_tree_origin true ist, sind sie (in
+    // beliebiger Reihenfolge) die Bäume first_tree_index bis
+    // first_tree_index + forest_size - 1 eines
+    // Walds mit dem Startwert random_seed (siehe TrainingSettings). In der
+    // JSON-Datei steht das als "Random seed" und "First tree index", daran
+    // erkennt merge_forests Teilwälder, die sich überschneiden. Ältere
+    // Modelle und Wälder mit Bäumen verschiedener Startwerte haben das nicht.
+    bool has_tree_origin;
+    unsigned int random_seed;
+    unsigned int first_tree_index;
+
+
+    ForestParameters()
+    {
+        set_window_radius(0);
+        max_tree_depth = 0;
+        testobject_tries = 0;
+        forest_size = 0;
+        model_type = 0;
+        has_tree_origin = false;
+        random_seed = 0;
+        first_tree_index = 0;
+    }
+
+
+    void set_window_radius(unsigned char radius)
+    {
+        window_radius = radius;
+        window_size = 2*radius + 1;
+    }
+};
+
+
+
+// Einstellungen für ein Training, die nicht zum Wald gehören und deshalb
+// nicht in seiner JSON-Datei stehen. training() legt für jeden Aufruf ein
+// eigenes Objekt an, das wie ForestParameters überall hingereicht wird, wo
+// einer der Werte gebraucht wird. Dadurch stören sich mehrere Trainings in
+// einem Prozess nicht.
+class TrainingSettings
+{
+
+public:
+    // wenn true, wird beim Training für jedes Trainingsbeispiel das ganze
+    // Fenster um das Pixel herum in einen zusammenhängenden Puffer kopiert
+    // (siehe SampleStore), sonst wird nur ein kompakter Index gespeichert
+    bool copy_sample_windows;
+
+    // wie die Entscheidungsbäume beim Training wachsen: 0 heißt Knoten für
+    // Knoten in Tiefensuche (Tree::train), 1 heißt Ebene für Ebene
+    // (Tree::train_levelwise), 2 heißt immer der beste Knoten zuerst
+    // (Tree::train_bestfirst), 3 heißt Ebene für Ebene als Dschungel mit
+    // zusammengelegten Knoten (Tree::train_jungle)
+    unsigned int growth_mode;
+
+    // höchstens so viele Knoten hat eine Ebene eines Dschungels, also eines
+    // Baums, der mit growth_mode 3 wächst (siehe Tree::train_jungle)
+    unsigned int jungle_width;
+
+    // höchstens so viele Blätter hat ein Baum, der mit growth_mode 2 wächst.
+    // 0 heißt unbegrenzt (dann begrenzt nur die maximale Tiefe).
+    unsigned int max_tree_leaves;
+
+    // wenn true, werden die Testobjekte in großen Knoten zuerst auf einer
+    // wachsenden Stichprobe der Trainingsbeispiele bewertet (siehe
+    // Node::preselect_candidates)
+    bool subsampled_split_scoring;
+
+    // wenn nicht leer, werden die Trainingsdaten ausgelagert: die
+    // Trainingsbilder werden aus dem Trainings-Cache und alles, was pro
+    // Trainingsbeispiel gespeichert wird (siehe SampleStore und
+    // OutOfBagEstimate), aus Dateien, deren Namen mit diesem Präfix beginnen,
+    // in den Speicher abgebildet (siehe MappedFile), statt es im
+    // Arbeitsspeicher zu halten. Ausnahme sind die Hashes und Gewichte in
+    // SampleStore::deduplicate.
+    std::string out_of_core_prefix;
+
+    // wenn größer als 0, die Zeit in Sekunden, die das Training höchstens
+    // dauern soll (siehe Forest::train_trees)
+    double time_budget;
+
+    // wenn größer als 0, der Zeitpunkt (siehe wall_time), an dem das
+    // Zeitbudget aufgebraucht ist. Forest::train_trees setzt ihn in seiner
+    // Kopie der Einstellungen; danach werden alle Knoten, die noch wachsen
+    // sollten, zu Blättern (siehe past_deadline).
+    double deadline;
+
+    // wenn größer als 0, wird dieser Anteil der Vordergrundpixel bei jedem
+    // Baum zurückgehalten. Mit den zurückgehaltenen und den nicht
+    // ausgewählten Hintergrundpixeln wird schon beim Training geschätzt, wie
+    // gut der Wald ist (siehe OutOfBagEstimate).
+    double out_of_bag_fraction;
+
+    // wenn true, werden beim Training Beispiele mit gleichem Label und
+    // gleichem Fenster zu einem Beispiel mit Gewicht zusammengefasst (siehe
+    // SampleStore::deduplicate)
+    bool deduplicate_samples;
+
+    // Augmentierung beim Training (siehe Augmentation): wenn
+    // augmentation_variants größer als 1 ist (höchstens 16), bekommt jeder
+    // Baum so viele zufällige Varianten (die erste ist immer unverändert),
+    // und jedes Trainingsbeispiel wird zufällig einer davon zugeordnet. Eine
+    // Variante ist eventuell gespiegelt, um bis zu augmentation_max_angle
+    // Grad gedreht und im Kontrast um einen Faktor zwischen
+    // 1 - augmentation_max_gain und 1 + augmentation_max_gain verändert.
+    unsigned int augmentation_variants;
+    bool augmentation_flips;
+    double augmentation_max_angle;
+    double augmentation_max_gain;
+
+    // wenn größer als 0, nehmen alle Testobjekte beim Training ihre Offsets
+    // aus einem Pool mit so vielen Paaren, der einmal pro Wald ausgewürfelt
+    // und mit dem Modell gespeichert wird (siehe
+    // PixelDifferenceTest::draw_offset_pool). Bei der Inferenz wird dann
+    // jede Differenz nur einmal pro Pixel berechnet und von allen Bäumen
+    // geteilt (siehe Forest::inference).
+    unsigned int offset_pool_size;
+
+    // Startwert für die Zufallsgeneratoren der Bäume (siehe Random) und der
+    // Index des ersten Baums, wenn nur ein Teilwald trainiert wird. Der Baum
+    // i des Teilwalds ist der Baum first_tree_index + i des ganzen Walds.
+    unsigned int random_seed;
+    unsigned int first_tree_index;
+
+    // so viele Threads verwenden die parallelen Schleifen des Trainings, 0
+    // heißt so viele, wie OpenMP von sich aus nimmt (siehe
+    // training_threads). Die Zahl wird an jeder Schleife angegeben statt mit
+    // omp_set_num_threads(), damit ein Training nicht die Threads eines
+    // anderen im selben Prozess ändert.
+    unsigned int number_of_threads;
+
+
+    // die Einstellungen für ein ganz normales Training (und fürs
+    // Nachtrainieren, siehe refit)
+    TrainingSettings()
+    {
+        copy_sample_windows = false;
+        growth_mode = 0;
+        jungle_width = 0;
+        max_tree_leaves = 0;
+        subsampled_split_scoring = false;
+        time_budget = 0.0;
+        deadline = 0.0;
+        out_of_bag_fraction = 0.0;
+        deduplicate_samples = false;
+        augmentation_variants = 0;
+        augmentation_flips = false;
+        augmentation_max_angle = 0.0;
+        augmentation_max_gain = 0.0;
+        offset_pool_size = 0;
+        random_seed = 0;
+        first_tree_index = 0;
+        number_of_threads = 0;
+    }
+};
+
+
+
+// Zufallsgenerator für das Training (SplitMix64, Steele et al., "Fast
+// Splittable Pseudorandom Number Generators", 2014). Jeder Baum bekommt
+// seinen eigenen, dessen Startwert aus random_seed und dem Index des Baums im
+// ganzen Wald gemischt wird (siehe TrainingData). Ein Baum hängt damit weder
+// davon ab, was die anderen Threads gerade würfeln, noch davon, in welchem
+// Teilwald er trainiert wird. std::rand() taugt dafür nicht, weil sich alle
+// Threads seinen Zustand teilen und RAND_MAX unter Windows nur 32767 ist.
+class Random
+{
+
+public:
+    unsigned long long state;
+
+
+    // Generator für den Strom stream (z.B. den Index eines Baums) zum
+    // Startwert seed. Verschiedene Ströme zum selben Startwert fangen an
+    // verschiedenen Stellen an.
+    Random(unsigned long long seed, unsigned long long stream)
+    {
+        state = mix(mix(seed + 0x9E3779B97F4A7C15ULL) + stream);
+    }
+
+
+    unsigned long long next()
+    {
+        state += 0x9E3779B97F4A7C15ULL;
+        return mix(state);
+    }
+
+
+    // gleichverteilte Zahl aus [0, n). Die Verzerrung durch den Modulo ist
+    // bei 64 Bit vernachlässigbar.
+    unsigned long index(unsigned long n)
+    {
+        return static_cast<unsigned long>(next() % n);
+    }
+
+
+    // gleichverteilte Zahl aus [0, 1)
+    double uniform()
+    {
+        return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+
+    static unsigned long long mix(unsigned long long z)
+    {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+};
+
+
+
+// Sekunden seit einem beliebigen, aber festen Zeitpunkt
+double wall_time()
+{
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    // ohne Threads ist die Prozessorzeit ungefähr die vergangene Zeit
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+
+// die Anzahl der Threads für die parallelen Schleifen eines Trainings mit
+// diesen Einstellungen
+int training_threads(const TrainingSettings& settings)
+{
+#ifdef _OPENMP
+    if(settings.number_of_threads >= 1) {
+        return settings.number_of_threads;
+    }
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+
+// ob das Zeitbudget des Trainings aufgebraucht ist. Die Bäume fragen das bei
+// jedem Knoten, so wird auch ein Baum, der gerade wächst, rechtzeitig
+// fertig.
+bool past_deadline(const TrainingSettings& settings)
+{
+    return settings.deadline > 0.0 && wall_time() > settings.deadline;
+}
+
+
+// Mit Zeitbudget werden die Versuche für die Testobjekte höchstens auf
+// testobject_tries / MIN_TRIES_DIVISOR verringert, damit die Bäume nicht zu
+// schlecht werden. Reicht die Zeit dann immer noch nicht, gibt es weniger
+// Bäume.
+const unsigned int MIN_TRIES_DIVISOR = 4;
+
+
+// Radius des Bandes um die Vordergrundpixel, aus dem bevorzugt
+// Hintergrundpixel fürs Training genommen werden (siehe
+// TrainingData::select_samples)
+const int BACKGROUND_BAND_RADIUS = 7;
 
-unsigned int GIBBS_SAMPLING_STEPS;
-double PAIRWISE_ENERGY;
-double PAIRWISE_FACTOR;
+// Kennung und Version der Datei mit dem Trainings-Cache (siehe
+// LabeledImages::write_cache)
+const char* const TRAINING_CACHE_MAGIC = "LAKASEGC";
+const unsigned int TRAINING_CACHE_VERSION = 1;
 
 
 
@@ -96,805 +382,4750 @@ CImg<unsigned char>* load_one_channel(std::string filename) {
 
 
 
-class TrainingData
-{
+// Klassen, in die die Pixel der Labelbilder eingeteilt werden (siehe
+// LabeledImages::classify)
+const unsigned char PIXEL_UNUSED = 0;
+const unsigned char PIXEL_BACKGROUND_BAND = 1;
+const unsigned char PIXEL_FOREGROUND = 2;
+const unsigned char PIXEL_BACKGROUND = 3;
 
-public:
 
-    std::vector<CImg<unsigned char>*> training_images;
-    // Für jedes Trainingsbild eine Maske mit den Labels:
-    // 1 ist Hintergrund, 2 ist Vordergrund, 0 wird beim Lernen ignoriert
-    std::vector<CImg<unsigned char>*> label_masks;
 
-    // die Farben für Vorder- und Hintergrund in den Ground-Truth-Bildern,
-    // damit bei der Inferenz wieder Label-Bilder mit diesen Farben produziert
-    // werden können
-    unsigned char background_color;
-    unsigned char foreground_color;
+// FNV-1a-Hash über den Inhalt mehrerer Dateien, um zu erkennen, ob ein
+// Trainings-Cache noch zu den Eingabebildern passt
+unsigned long long hash_files(std::vector<std::string>& filenames, unsigned long long hash)
+{
+    std::vector<char> buffer(1 << 16);
+    for(size_t f = 0; f < filenames.size(); ++f) {
+        std::ifstream in(filenames[f].c_str(), std::ios::binary);
+        if(!in) {
+            std::cerr << "Fehler: " << filenames[f] << " konnte nicht gelesen werden" << std::endl;
+            std::exit(1);
+        }
+        while(in) {
+            in.read(&buffer[0], buffer.size());
+            for(std::streamsize i = 0; i < in.gcount(); ++i) {
+                hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ULL;
+            }
+        }
+        // Dateigrenze mit in den Hash nehmen
+        hash = (hash ^ 0xff) * 1099511628211ULL;
+    }
+    return hash;
+}
 
-    unsigned int number_of_labeled_pixels;
 
+template <typename V>
+void write_binary(std::ostream& out, V value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(V));
+}
 
 
-    TrainingData(std::vector<std::string> training_image_filenames, std::vector<std::string> label_filenames) {
+template <typename V>
+bool read_binary(std::istream& in, V& value)
+{
+    in.read(reinterpret_cast<char*>(&value), sizeof(V));
+    return static_cast<bool>(in);
+}
 
-        if(training_image_filenames.size() != label_filenames.size()) {
-            std::cerr << "Fehler: Ungleiche Anzahl von Trainings- und Labelbildern" << std::endl;
-            std::exit(1);
-        }
 
-        this->background_color = 0;
-        this->foreground_color = 0;
-        this->number_of_labeled_pixels = 0;
 
-        for(unsigned int i = 0; i < training_image_filenames.size(); ++i) {
-            training_images.push_back(load_one_channel(training_image_filenames[i]));
+// Eine Datei, die in den Speicher abgebildet wird. Das Betriebssystem lädt
+// dann nur die Teile, die gerade gebraucht werden, und kann sie bei
+// Speichermangel wieder verwerfen, so dass mehr Daten verarbeitet werden
+// können, als in den Arbeitsspeicher passen. Unter Windows gibt es kein
+// mmap(), dort wird einfach normaler Speicher verwendet.
+class MappedFile
+{
+public:
+    unsigned char* data;
+    size_t size;
 
 
-            // das Bild mit den Labels laden und daraus die Maske erstellen
+    MappedFile()
+    {
+        this->data = NULL;
+        this->size = 0;
+    }
 
-            CImg<unsigned char>* labels = load_one_channel(label_filenames[i]);
 
-            if(training_images[i]->width() != labels->width() || training_images[i]->height() != labels->height()) {
-                std::cerr << "Fehler: " << training_image_filenames[i] << " muss die gleiche Größe haben wie " << label_filenames[i] << std::endl;
-                std::exit(1);
-            }
+    ~MappedFile()
+    {
+        unmap();
+    }
 
-            // die zwei in den Ground-Truth-Bildern vorkommenden Farben raussuchen
-            cimg_forXY((*labels), x, y) {
-                unsigned char c = (*labels)(x, y);
-                if(c != 0) {
-                    if(this->background_color == 0) {
-                        this->background_color = c;
-                    } else {
-                        if(c != this->background_color && this->foreground_color == 0) {
-                            this->foreground_color = c;
-                            // Hässliches goto statt break, weil cimg_forXY ein
-                            // Makro ist, das nach verschachtelten
-                            // for-Schleifen expandiert. Ein break würde nur
-                            // aus der innersten Schleife ausbrechen. Ich hatte
-                            // schonmal Scherereien deswegen, darum verwende
-                            // ich in diesen Schleifen immer goto statt break
-                            goto break1;
-                        }
-                    }
-                }
-            }
-break1:
-
-            // wir gehen davon aus, dass der Vordergrund ein helleres Label als
-            // der Hintergrund hat, deshalb wird der Wert hier ggf. vertauscht
-            if(this->foreground_color < this->background_color) {
-                unsigned char h = this->background_color;
-                this->background_color = this->foreground_color;
-                this->foreground_color = h;
-            }
-
-
-            CImg<unsigned char>* new_label_mask = new CImg<unsigned char>(labels->width(), labels->height(), 1, 1, 0);
-            label_masks.push_back(new_label_mask);
-
-
-            // da in den meisten Trainingsbildern deutlich mehr Vordergrund- als
-            // Hintergrundpixel vorkommen dürften, werden von den
-            // Vordergrundpixeln alle (mit 2) markiert (und damit beim Training
-            // verwendet), aber von den Hintergrundpixeln werden nur welche
-            // ausgewürfelt (so viele wie Vordergrundpixel)
-            unsigned long number_of_foreground_pixels = 0;
-            unsigned long number_of_background_pixels = 0;
-            cimg_for_insideXY(*new_label_mask, x, y, WINDOW_RADIUS) {
-                unsigned char c = (*labels)(x, y);
-
-                if(c != 0) {
-                    if(c == this->background_color) {
-                        ++number_of_background_pixels;
-                    } else {
-                        if(c == this->foreground_color) {
-                            (*new_label_mask)(x, y) = 2;
-                            ++number_of_labeled_pixels;
-                            ++number_of_foreground_pixels;
-                        } else {
-                            std::cout << "Es darf höchtens 2 verschiedene Labels geben" << std::endl;
-                            exit(1);
-                        }
-                    }
-                }
+
+    // bildet eine vorhandene Datei zum Lesen ab
+    bool map(const char* filename)
+    {
+        unmap();
+#ifdef _WIN32
+        std::ifstream in(filename, std::ios::binary);
+        if(!in) {
+            return false;
+        }
+        in.seekg(0, std::ios::end);
+        fallback.resize(static_cast<size_t>(in.tellg()));
+        in.seekg(0);
+        if(!fallback.empty()) {
+            in.read(reinterpret_cast<char*>(&fallback[0]), fallback.size());
+            data = &fallback[0];
+        }
+        size = fallback.size();
+        return static_cast<bool>(in);
+#else
+        int fd = open(filename, O_RDONLY);
+        if(fd < 0) {
+            return false;
+        }
+        off_t file_size = lseek(fd, 0, SEEK_END);
+        if(file_size > 0) {
+            void* address = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+            if(address != MAP_FAILED) {
+                data = static_cast<unsigned char*>(address);
+                size = file_size;
             }
+        }
+        close(fd);
+        return data != NULL;
+#endif
+    }
 
-            if(number_of_background_pixels > number_of_foreground_pixels) {
-
-                // von den Hintergrundpixeln werden auch alle markiert, die
-                // sich in einem gewissen Radius rund um Vordergrundgebiete
-                // befinden, weil die möglicherweise etwas interessanter für
-                // die Unterscheidung zwischen Vorder- und Hintergrund sind
-                new_label_mask->dilate(15); // dehnt die Vordergrundpixel quasi aus
-                cimg_for_insideXY(*new_label_mask, x, y, WINDOW_RADIUS) {
-                    if((*new_label_mask)(x, y) == 2 && (*labels)(x, y) != this->foreground_color) {
-                        (*new_label_mask)(x, y) = 1;
-                        --number_of_foreground_pixels;
-                        ++number_of_labeled_pixels;
-                        if(number_of_foreground_pixels <= 0ul) {
-                            goto break2;
-                        }
-                    }
-                }
-break2:
-
-
-                // dann im Rest des Bildes zufällig Hintergrundpixel auswählen
-                // und markieren, bis wir so viele wie Vordergrund markiert
-                // haben
-                for(unsigned long i = 0; i < number_of_foreground_pixels; ++i) {
-                    while(true) {
-                        int x = (std::rand() % (labels->width() - 2*WINDOW_RADIUS)) + WINDOW_RADIUS;
-                        int y = (std::rand() % (labels->height() - 2*WINDOW_RADIUS)) + WINDOW_RADIUS;
-                        if((*labels)(x, y) == this->background_color && (*new_label_mask)(x, y) == 0) {
-                            (*new_label_mask)(x, y) = 1;
-                            ++number_of_labeled_pixels;
-                            break;
-                        }
-                    }
-                }
 
-            } else {  // wenn es doch mehr Vordergrund- als Hintergrundpixel gibt, werden auch alle Hintergrundpixel markiert
-                cimg_forXY((*new_label_mask), x, y) {
-                    if((*labels)(x, y) == this->background_color) {
-                        (*new_label_mask)(x, y) = 1;
-                        ++number_of_labeled_pixels;
-                    }
-                }
+    // legt eine Datei mit size Bytes an und bildet sie zum Lesen und
+    // Schreiben ab. Der Dateiname beginnt mit filename_prefix, den Rest
+    // wählt mkstemp() so, dass es die Datei noch nicht gibt. Die Datei wird
+    // gleich wieder gelöscht, die Daten bleiben aber bis zum unmap() da.
+    void create_temporary(std::string filename_prefix, size_t size)
+    {
+        unmap();
+        if(size == 0) {
+            return;
+        }
+#ifdef _WIN32
+        fallback.resize(size);
+        this->data = &fallback[0];
+        this->size = size;
+#else
+        // mkstemp() legt die Datei exklusiv an, so kommen sich auch
+        // mehrere Trainings mit demselben Präfix nicht in die Quere, egal
+        // ob in verschiedenen Prozessen oder Threads
+        std::string filename = filename_prefix + ".XXXXXX";
+        std::vector<char> name(filename.begin(), filename.end());
+        name.push_back('\0');
+        int fd = mkstemp(&name[0]);
+        void* address = MAP_FAILED;
+        if(fd >= 0) {
+            unlink(&name[0]);
+            if(ftruncate(fd, size) == 0) {
+                address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
             }
-
-            delete labels;
+            close(fd);
+        }
+        if(address == MAP_FAILED) {
+            std::cerr << "Fehler: " << filename << " konnte nicht angelegt werden" << std::endl;
+            std::exit(1);
         }
+        this->data = static_cast<unsigned char*>(address);
+        this->size = size;
+#endif
     }
 
 
-    ~TrainingData() {
-        for(unsigned int i = 0; i < training_images.size(); ++i) {
-            delete training_images[i];
-            delete label_masks[i];
+    void unmap()
+    {
+#ifdef _WIN32
+        std::vector<unsigned char>().swap(fallback);
+#else
+        if(data != NULL) {
+            munmap(data, size);
         }
+#endif
+        data = NULL;
+        size = 0;
     }
+
+
+private:
+#ifdef _WIN32
+    std::vector<unsigned char> fallback;
+#endif
+
+    // nicht kopierbar, sonst würde die Abbildung zweimal aufgehoben
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
 };
 
 
 
-// jeder Blattknoten der Entscheidungsbäume hat einen Zeiger auf so ein
-// LeafInfo-Objekt. Es enthält einfach die (empirische) Wahrscheinlichkeit,
-// dass das Pixel, das an diesem Blattknoten ankommt, ein Vordergrundpixel ist
-class LeafInfo
+// Ein Feld mit einem Eintrag vom Typ V pro Trainingsbeispiel. Ist beim
+// Anlegen ein Dateiname angegeben, liegt es in einer in den Speicher
+// abgebildeten temporären Datei (siehe MappedFile), sonst in normalem
+// Speicher. Die Einträge sind am Anfang 0.
+template <typename V>
+class SampleBuffer
 {
-
 public:
-    double foreground_probability;
 
-    JSONValue* to_json()
+    SampleBuffer()
     {
-        return new JSONValue(foreground_probability);
+        this->values = NULL;
+        this->length = 0;
     }
 
-    static LeafInfo* from_json(JSONValue* value)
+
+    // legt Platz für length Einträge an, bei leerem filename_prefix im
+    // Arbeitsspeicher. Vorherige Einträge gehen verloren.
+    void allocate(size_t length, const std::string& filename_prefix)
     {
-        LeafInfo* new_leafinfo = new LeafInfo;
-        new_leafinfo->foreground_probability = value->AsNumber();
-        return new_leafinfo;
+        std::vector<V>().swap(memory);
+        mapped.unmap();
+        if(filename_prefix.empty()) {
+            memory.resize(length);
+            values = (length > 0 ? &memory[0] : NULL);
+        } else {
+            mapped.create_temporary(filename_prefix, length * sizeof(V));
+            values = reinterpret_cast<V*>(mapped.data);
+        }
+        this->length = length;
     }
-};
-
-
-
-
-// jeder innere Knoten eines Entscheidungsbaums hat einen Zeiger auf ein
-// Testobjekt, das (mit der Funktion goes_left()) ein Pixel entweder nach links
-// oder nach rechts im Entscheidungsbaum weiterschickt
-
-// Hier werden 3 verschiedene Varianten solcher Klassen definiert, aber nur
-// PixelDifferenceTest wird verwendet. Die anderen beiden kann man zum debuggen
-// verwenden.
 
 
-// so ein Testobjekt testet, ob der Unterschied der Grauwerte von zwei
-// bestimmten Pixeln in der Nachbarschaft des zu klassifizierenden Pixels
-// kleiner oder größer als ein Schwellwert ist
-class PixelDifferenceTest
-{
-public:
-    short offset_pixel1_x;
-    short offset_pixel1_y;
-    short offset_pixel2_x;
-    short offset_pixel2_y;
-    short difference_threshold;
-    static std::wstring name;
+    // behält nur die ersten length Einträge. Der Platz dahinter wird nicht
+    // freigegeben.
+    void shrink(size_t length)
+    {
+        this->length = std::min(this->length, length);
+    }
 
 
-    bool goes_left(CImg<unsigned char>* image, unsigned int x, unsigned int y)
+    size_t size() const
     {
-        return ((*image)(x + offset_pixel1_x, y + offset_pixel1_y) - (*image)(x + offset_pixel2_x, y + offset_pixel2_y)) < difference_threshold;
+        return length;
     }
 
 
-    // ein Testobjekt wird erzeugt, indem einfach zufällig innerhalb kleinen
-    // Fenster rund um ein Pixel zwei Nachbarpositionen und der Schwellwert
-    // ausgewürfelt werden
-    static PixelDifferenceTest* sample()
-    {
-        PixelDifferenceTest* testobject = new PixelDifferenceTest;
-        testobject->offset_pixel1_x = (std::rand() % WINDOW_SIZE) - WINDOW_RADIUS;
-        testobject->offset_pixel1_y = (std::rand() % WINDOW_SIZE) - WINDOW_RADIUS;
-        testobject->offset_pixel2_x = (std::rand() % WINDOW_SIZE) - WINDOW_RADIUS;
-        testobject->offset_pixel2_y = (std::rand() % WINDOW_SIZE) - WINDOW_RADIUS;
-        testobject->difference_threshold = (std::rand() % 511) - 255;
-        return testobject;
+    bool empty() const
+    {
+        return length == 0;
     }
 
 
-    JSONValue* to_json()
+    V& operator[](size_t i)
     {
-        JSONArray array;
-        array.push_back(new JSONValue(static_cast<double>(offset_pixel1_x)));
-        array.push_back(new JSONValue(static_cast<double>(offset_pixel1_y)));
-        array.push_back(new JSONValue(static_cast<double>(offset_pixel2_x)));
-        array.push_back(new JSONValue(static_cast<double>(offset_pixel2_y)));
-        array.push_back(new JSONValue(static_cast<double>(difference_threshold)));
-        return new JSONValue(array);
+        return values[i];
     }
 
 
-    static PixelDifferenceTest* from_json(JSONValue* value)
+    V* begin()
     {
-        JSONArray array = value->AsArray();
-        PixelDifferenceTest* testobject = new PixelDifferenceTest;
-        testobject->offset_pixel1_x = static_cast<short>(array[0]->AsNumber());
-        testobject->offset_pixel1_y = static_cast<short>(array[1]->AsNumber());
-        testobject->offset_pixel2_x = static_cast<short>(array[2]->AsNumber());
-        testobject->offset_pixel2_y = static_cast<short>(array[3]->AsNumber());
-        testobject->difference_threshold = static_cast<short>(array[4]->AsNumber());
-        return testobject;
+        return values;
     }
-};
 
-// statische Member müssen in C++ immer außerhalb der Klasse definiert werden ...
-std::wstring PixelDifferenceTest::name = L"PixelDifferenceTest";
 
+private:
+    V* values;
+    size_t length;
+    std::vector<V> memory;
+    MappedFile mapped;
 
+    SampleBuffer(const SampleBuffer&);
+    SampleBuffer& operator=(const SampleBuffer&);
+};
 
-/*
-// zwei weitere Testfunktionen, die eventuell zum Debuggen nützlich sind
 
-// so ein Testobjekt beachtet die Nachbarpixel überhaupt nicht, sondern testet
-// einfach, ob das zu klassifizierende Pixel größer oder kleiner als ein
-// Schwellwert ist
-class PixelValueTest
+
+// Die Trainingsbilder und ihre Labels, so wie sie aus den Dateien (oder aus
+// einem Trainings-Cache) gelesen werden. Das Objekt wird nur einmal erstellt
+// und dann von allen Bäumen gemeinsam benutzt, die daraus jeweils ihre
+// eigenen Trainingsbeispiele auswählen (siehe TrainingData).
+class LabeledImages
 {
+
 public:
-    unsigned char threshold;
-    static std::wstring name;
 
-    bool goes_left(CImg<unsigned char>* image, unsigned int x, unsigned int y)
-    {
-        return (*image)(x, y) < threshold;
-    }
+    std::vector<CImg<unsigned char>*> training_images;
+
+    // Für jedes Trainingsbild eine Karte, in der jedem Pixel eine der
+    // Klassen PIXEL_* zugeordnet ist
+    std::vector<CImg<unsigned char>*> pixel_classes;
+
+    // die Farben für Vorder- und Hintergrund in den Ground-Truth-Bildern,
+    // damit bei der Inferenz wieder Label-Bilder mit diesen Farben produziert
+    // werden können
+    unsigned char background_color;
+    unsigned char foreground_color;
+
+    // für jedes Trainingsbild die Anzahl der Pixel in den Klassen
+    // PIXEL_FOREGROUND, PIXEL_BACKGROUND_BAND und PIXEL_BACKGROUND
+    std::vector<unsigned long> foreground_counts;
+    std::vector<unsigned long> band_counts;
+    std::vector<unsigned long> background_counts;
+
+    // ob die Bilder ausgelagert werden, und dann der in den Speicher
+    // abgebildete Trainings-Cache, auf den training_images und pixel_classes
+    // zeigen
+    bool out_of_core;
+    MappedFile mapped_cache;
+
+    // Fensterradius des Walds, für den die Bilder geladen werden. In einem
+    // Rand dieser Breite liegen keine Trainingsbeispiele.
+    unsigned char window_radius;
+
 
-    static PixelValueTest* sample()
+    LabeledImages(unsigned char window_radius, bool out_of_core)
     {
-        PixelValueTest* testobject = new PixelValueTest;
-        testobject->threshold = std::rand() % 256;
-        return testobject;
+        this->background_color = 0;
+        this->foreground_color = 0;
+        this->window_radius = window_radius;
+        this->out_of_core = out_of_core;
     }
 
-    JSONValue* to_json()
+
+    ~LabeledImages()
     {
-        return new JSONValue(static_cast<double>(threshold));
+        clear();
     }
-};
 
-std::wstring PixelValueTest::name = L"PixelValueTest";
 
+    void clear()
+    {
+        for(unsigned int i = 0; i < training_images.size(); ++i) {
+            delete training_images[i];
+            delete pixel_classes[i];
+        }
+        training_images.clear();
+        pixel_classes.clear();
+        foreground_counts.clear();
+        band_counts.clear();
+        background_counts.clear();
+        mapped_cache.unmap();
+        this->background_color = 0;
+        this->foreground_color = 0;
+    }
 
 
-// so ein Testobjekt testet, ob ein bestimmtes Pixel inder Nachbarschaft heller
-// oder dunkler als ein Schwellwert ist
-class AxisAlignedTest
+    // lädt die Trainings- und Labelbilder. Wenn cache_filename nicht NULL
+    // ist, wird zuerst versucht, sie aus diesem Trainings-Cache zu lesen.
+    // Passt der Cache nicht (mehr) zu den Eingabedateien oder zum
+    // Fensterradius, wird er danach neu geschrieben. Mit out_of_core wird
+    // der Cache in den Speicher abgebildet (dann muss cache_filename
+    // angegeben sein).
+    static LabeledImages* load(std::vector<std::string> training_image_filenames, std::vector<std::string> label_filenames, const char* cache_filename, unsigned char window_radius, bool out_of_core)
+    {
+        if(training_image_filenames.size() != label_filenames.size()) {
+            std::cerr << "Fehler: Ungleiche Anzahl von Trainings- und Labelbildern" << std::endl;
+            std::exit(1);
+        }
+
+        LabeledImages* data = new LabeledImages(window_radius, out_of_core);
+
+        unsigned long long cache_key = 0;
+        if(cache_filename != NULL) {
+            cache_key = hash_files(training_image_filenames, 14695981039346656037ULL);
+            cache_key = hash_files(label_filenames, cache_key);
+            if(data->read_cache(cache_filename, cache_key)) {
+                return data;
+            }
+        }
+
+        // beim Auslagern wird jedes Bild gleich in den Cache geschrieben und
+        // wieder freigegeben; danach wird der Cache in den Speicher abgebildet
+        std::ofstream out_of_core_cache;
+        if(out_of_core) {
+            out_of_core_cache.open(cache_filename, std::ios::binary);
+            if(!out_of_core_cache) {
+                std::cerr << "Fehler: Trainings-Cache " << cache_filename << " konnte nicht geschrieben werden" << std::endl;
+                std::exit(1);
+            }
+            data->write_cache_header(out_of_core_cache, cache_key, training_image_filenames.size());
+        }
+
+        for(unsigned int i = 0; i < training_image_filenames.size(); ++i) {
+            data->training_images.push_back(load_one_channel(training_image_filenames[i]));
+
+            CImg<unsigned char>* labels = load_one_channel(label_filenames[i]);
+
+            if(data->training_images[i]->width() != labels->width() || data->training_images[i]->height() != labels->height()) {
+                std::cerr << "Fehler: " << training_image_filenames[i] << " muss die gleiche Größe haben wie " << label_filenames[i] << std::endl;
+                std::exit(1);
+            }
+
+            data->classify(*labels);
+
+            delete labels;
+
+            if(out_of_core_cache.is_open()) {
+                data->write_cache_image(out_of_core_cache, i);
+                delete data->training_images[i];
+                delete data->pixel_classes[i];
+                data->training_images[i] = NULL;
+                data->pixel_classes[i] = NULL;
+            }
+        }
+
+        if(out_of_core_cache.is_open()) {
+            // erst jetzt sind die Labelfarben bekannt
+            out_of_core_cache.seekp(0);
+            data->write_cache_header(out_of_core_cache, cache_key, training_image_filenames.size());
+            out_of_core_cache.close();
+            data->clear();
+            if(!out_of_core_cache || !data->read_cache(cache_filename, cache_key)) {
+                std::cerr << "Fehler: Trainings-Cache " << cache_filename << " konnte nicht gelesen werden" << std::endl;
+                std::exit(1);
+            }
+        } else if(cache_filename != NULL) {
+            data->write_cache(cache_filename, cache_key);
+        }
+
+        return data;
+    }
+
+
+    // teilt die Pixel eines Labelbilds in die Klassen PIXEL_* ein. Der
+    // Aufwand ist linear in der Anzahl der Pixel.
+    // Hintergrundpixel, die sich in einem gewissen Radius rund um
+    // Vordergrundgebiete befinden, bekommen eine eigene Klasse, weil die
+    // möglicherweise etwas interessanter für die Unterscheidung zwischen
+    // Vorder- und Hintergrund sind und deshalb bevorzugt fürs Training
+    // genommen werden.
+    void classify(CImg<unsigned char>& labels)
+    {
+        // Histogramm der Labelfarben, einmal im ganzen Bild und einmal ohne
+        // den Rand, wo keine Trainingsbeispiele liegen können
+        unsigned long histogram[256] = { 0 };
+        unsigned long inside_histogram[256] = { 0 };
+        cimg_forXY(labels, x, y) {
+            unsigned char c = labels(x, y);
+            ++histogram[c];
+            if(x >= window_radius && y >= window_radius && x < labels.width() - window_radius && y < labels.height() - window_radius) {
+                ++inside_histogram[c];
+            }
+        }
+
+        // die zwei in den Ground-Truth-Bildern vorkommenden Farben raussuchen
+        for(unsigned int c = 1; c < 256; ++c) {
+            if(histogram[c] > 0) {
+                if(this->background_color == 0) {
+                    this->background_color = c;
+                } else if(c != this->background_color && this->foreground_color == 0) {
+                    this->foreground_color = c;
+                }
+            }
+        }
+
+        // wir gehen davon aus, dass der Vordergrund ein helleres Label als
+        // der Hintergrund hat, deshalb wird der Wert hier ggf. vertauscht
+        if(this->foreground_color < this->background_color) {
+            unsigned char h = this->background_color;
+            this->background_color = this->foreground_color;
+            this->foreground_color = h;
+        }
+
+        for(unsigned int c = 1; c < 256; ++c) {
+            if(inside_histogram[c] > 0 && c != this->background_color && c != this->foreground_color) {
+                std::cout << "Es darf höchtens 2 verschiedene Labels geben" << std::endl;
+                exit(1);
+            }
+        }
+
+        CImg<unsigned char>* classes = new CImg<unsigned char>(labels.width(), labels.height(), 1, 1, PIXEL_UNUSED);
+        cimg_for_insideXY(*classes, x, y, window_radius) {
+            if(labels(x, y) == this->foreground_color) {
+                (*classes)(x, y) = PIXEL_FOREGROUND;
+            }
+        }
+
+
+        // Band um die Vordergrundpixel: alle Pixel, deren Abstand in der
+        // Maximumsnorm zum nächsten Vordergrundpixel höchstens
+        // BACKGROUND_BAND_RADIUS ist. Das wird getrennt für Zeilen und
+        // Spalten mit je zwei Durchläufen ausgerechnet, die sich jeweils den
+        // Abstand zum zuletzt gesehenen Vordergrundpixel merken.
+        const int r = BACKGROUND_BAND_RADIUS;
+        const int far = labels.width() + labels.height() + r + 1;
+        CImg<unsigned char> near_in_row(labels.width(), labels.height(), 1, 1, 0);
+        cimg_forY(labels, y) {
+            int last = -far;
+            cimg_forX(labels, x) {
+                if((*classes)(x, y) == PIXEL_FOREGROUND) {
+                    last = x;
+                }
+                near_in_row(x, y) = (x - last <= r);
+            }
+            last = far;
+            for(int x = labels.width() - 1; x >= 0; --x) {
+                if((*classes)(x, y) == PIXEL_FOREGROUND) {
+                    last = x;
+                }
+                near_in_row(x, y) |= (last - x <= r);
+            }
+        }
+
+        CImg<unsigned char> band(labels.width(), labels.height(), 1, 1, 0);
+        cimg_forX(labels, x) {
+            int last = -far;
+            cimg_forY(labels, y) {
+                if(near_in_row(x, y)) {
+                    last = y;
+                }
+                band(x, y) = (y - last <= r);
+            }
+            last = far;
+            for(int y = labels.height() - 1; y >= 0; --y) {
+                if(near_in_row(x, y)) {
+                    last = y;
+                }
+                band(x, y) |= (last - y <= r);
+            }
+        }
+
+        unsigned long foreground_count = 0;
+        unsigned long band_count = 0;
+        unsigned long background_count = 0;
+        cimg_for_insideXY(*classes, x, y, window_radius) {
+            if((*classes)(x, y) == PIXEL_FOREGROUND) {
+                ++foreground_count;
+            } else if(this->background_color != 0 && labels(x, y) == this->background_color) {
+                if(band(x, y)) {
+                    (*classes)(x, y) = PIXEL_BACKGROUND_BAND;
+                    ++band_count;
+                } else {
+                    (*classes)(x, y) = PIXEL_BACKGROUND;
+                    ++background_count;
+                }
+            }
+        }
+
+        pixel_classes.push_back(classes);
+        foreground_counts.push_back(foreground_count);
+        band_counts.push_back(band_count);
+        background_counts.push_back(background_count);
+    }
+
+
+    // Der Trainings-Cache ist eine Binärdatei mit einem Kopf von 64 Byte
+    // (Kennung, Version, Fensterradius, Hash der Eingabedateien, Anzahl der
+    // Bilder, Labelfarben). Danach kommt für jedes Bild ein Kopf von 32 Byte
+    // (Breite, Höhe, die drei Pixelanzahlen) und dann das Bild und die Karte
+    // der Pixelklassen mit je einem Byte pro Pixel, aufgefüllt auf ein
+    // Vielfaches von 8 Byte. Alle Daten liegen also ausgerichtet in der
+    // Datei und werden beim Auslagern direkt in den Speicher abgebildet.
+    void write_cache(const char* cache_filename, unsigned long long cache_key)
+    {
+        std::ofstream out(cache_filename, std::ios::binary);
+        if(!out) {
+            std::cerr << "Warnung: Trainings-Cache " << cache_filename << " konnte nicht geschrieben werden" << std::endl;
+            return;
+        }
+
+        write_cache_header(out, cache_key, training_images.size());
+        for(unsigned int i = 0; i < training_images.size(); ++i) {
+            write_cache_image(out, i);
+        }
+    }
+
+
+    void write_cache_header(std::ostream& out, unsigned long long cache_key, unsigned int image_count)
+    {
+        out.write(TRAINING_CACHE_MAGIC, 8);
+        write_binary(out, TRAINING_CACHE_VERSION);
+        write_binary(out, static_cast<unsigned int>(this->window_radius));
+        write_binary(out, cache_key);
+        write_binary(out, image_count);
+        write_binary(out, this->background_color);
+        write_binary(out, this->foreground_color);
+        out.write(std::string(64 - 30, '\0').c_str(), 64 - 30);
+    }
+
+
+    void write_cache_image(std::ostream& out, unsigned int i)
+    {
+        unsigned int width = training_images[i]->width();
+        unsigned int height = training_images[i]->height();
+        write_binary(out, width);
+        write_binary(out, height);
+        write_binary(out, static_cast<unsigned long long>(foreground_counts[i]));
+        write_binary(out, static_cast<unsigned long long>(band_counts[i]));
+        write_binary(out, static_cast<unsigned long long>(background_counts[i]));
+
+        unsigned long pixels = static_cast<unsigned long>(width) * height;
+        std::string padding((8 - pixels % 8) % 8, '\0');
+        out.write(reinterpret_cast<const char*>(training_images[i]->data()), pixels);
+        out.write(padding.c_str(), padding.size());
+        out.write(reinterpret_cast<const char*>(pixel_classes[i]->data()), pixels);
+        out.write(padding.c_str(), padding.size());
+    }
+
+
+    // liest den Trainings-Cache. Gibt false zurück, wenn es ihn nicht gibt
+    // oder er nicht zu cache_key und window_radius passt.
+    bool read_cache(const char* cache_filename, unsigned long long cache_key)
+    {
+        std::ifstream in(cache_filename, std::ios::binary);
+        if(!in) {
+            return false;
+        }
+
+        char magic[8];
+        unsigned int version, cache_window_radius, image_count;
+        unsigned long long key;
+        in.read(magic, 8);
+        if(!in || std::string(magic, 8) != std::string(TRAINING_CACHE_MAGIC, 8) ||
+                !read_binary(in, version) || version != TRAINING_CACHE_VERSION ||
+                !read_binary(in, cache_window_radius) || cache_window_radius != this->window_radius ||
+                !read_binary(in, key) || key != cache_key ||
+                !read_binary(in, image_count) ||
+                !read_binary(in, this->background_color) ||
+                !read_binary(in, this->foreground_color)) {
+            this->background_color = 0;
+            this->foreground_color = 0;
+            return false;
+        }
+        in.seekg(64);
+
+        // beim Auslagern zeigen die Bilder direkt in den abgebildeten Cache
+        bool mapped = false;
+        if(out_of_core) {
+            if(!mapped_cache.map(cache_filename)) {
+                this->background_color = 0;
+                this->foreground_color = 0;
+                return false;
+            }
+            mapped = true;
+        }
+        size_t offset = 64;
+
+        for(unsigned int i = 0; i < image_count; ++i) {
+            unsigned int width, height;
+            unsigned long long foreground_count, band_count, background_count;
+            if(!read_binary(in, width) || !read_binary(in, height) ||
+                    !read_binary(in, foreground_count) || !read_binary(in, band_count) || !read_binary(in, background_count)) {
+                clear();
+                return false;
+            }
+
+            unsigned long pixels = static_cast<unsigned long>(width) * height;
+            unsigned long padding = (8 - pixels % 8) % 8;
+            offset += 32;
+
+            if(mapped) {
+                if(offset + 2 * (pixels + padding) > mapped_cache.size) {
+                    clear();
+                    return false;
+                }
+                // geteilte CImg-Objekte geben den Speicher nicht selbst frei
+                training_images.push_back(new CImg<unsigned char>(mapped_cache.data + offset, width, height, 1, 1, true));
+                pixel_classes.push_back(new CImg<unsigned char>(mapped_cache.data + offset + pixels + padding, width, height, 1, 1, true));
+                offset += 2 * (pixels + padding);
+                in.seekg(offset);
+            } else {
+                CImg<unsigned char>* image = new CImg<unsigned char>(width, height, 1, 1);
+                CImg<unsigned char>* classes = new CImg<unsigned char>(width, height, 1, 1);
+                training_images.push_back(image);
+                pixel_classes.push_back(classes);
+                in.read(reinterpret_cast<char*>(image->data()), pixels);
+                in.seekg(padding, std::ios::cur);
+                in.read(reinterpret_cast<char*>(classes->data()), pixels);
+                in.seekg(padding, std::ios::cur);
+                if(!in) {
+                    clear();
+                    return false;
+                }
+            }
+
+            foreground_counts.push_back(foreground_count);
+            band_counts.push_back(band_count);
+            background_counts.push_back(background_count);
+        }
+
+        std::cout << "Trainingsdaten aus " << cache_filename << " gelesen" << std::endl;
+        return true;
+    }
+};
+
+
+
+// Die Trainingsbeispiele für einen Baum.
+// Da in den meisten Trainingsbildern deutlich mehr Hintergrund- als
+// Vordergrundpixel vorkommen dürften, werden von den Vordergrundpixeln alle
+// beim Training verwendet, aber von den Hintergrundpixeln werden nur so
+// viele wie Vordergrundpixel ausgewürfelt, bevorzugt aus dem Band um die
+// Vordergrundgebiete. Das passiert für jeden Baum neu, die Bilder selbst
+// gehören dem LabeledImages-Objekt.
+// Mit TrainingSettings::out_of_bag_fraction wird ein Teil der
+// Vordergrundpixel nicht ausgewählt. Alle gelabelten Pixel, die nicht
+// ausgewählt sind, hat der Baum also nie gesehen (siehe OutOfBagEstimate).
+//
+// Hier stehen nur die Anzahlen, die aus jeder Pixelklasse ausgewählt werden,
+// und der Startwert fürs Auswürfeln. Welche Pixel es sind, wird erst beim
+// Durchlaufen mit SelectedPixels ausgewürfelt, so braucht kein Baum eine
+// eigene Maske so groß wie die Trainingsbilder.
+// Jeder Baum würfelt mit seinem eigenen Zufallsgenerator random, der danach
+// auch für seine Testobjekte verwendet wird.
+class TrainingData
 {
+
 public:
 
-    short offset_x;
-    short offset_y;
-    unsigned char threshold;
-    static std::wstring name;
+    std::vector<CImg<unsigned char>*> training_images;
+
+    // die Pixelklassen aus LabeledImages und pro Bild, wieviele Pixel es in
+    // jeder Klasse gibt und wieviele davon ausgewählt werden
+    std::vector<CImg<unsigned char>*> pixel_classes;
+    std::vector<unsigned long> foreground_counts;
+    std::vector<unsigned long> band_counts;
+    std::vector<unsigned long> background_counts;
+    std::vector<unsigned long> selected_foreground;
+    std::vector<unsigned long> selected_band;
+    std::vector<unsigned long> selected_background;
+
+    unsigned char background_color;
+    unsigned char foreground_color;
+
+    unsigned long number_of_labeled_pixels;
+
+    // die Parameter des Walds, für den die Beispiele ausgewählt werden, und
+    // die Einstellungen des Trainings
+    const ForestParameters* parameters;
+    const TrainingSettings* settings;
+
+    Random random;
+
+    // Startwert für das Auswürfeln der ausgewählten Pixel (siehe
+    // SelectedPixels)
+    unsigned long long selection_seed;
+
+
+    // tree_index ist der Index des Baums im ganzen Wald
+    TrainingData(LabeledImages& data, const ForestParameters& parameters, const TrainingSettings& settings, unsigned long tree_index)
+        : random(settings.random_seed, tree_index)
+    {
+
+        this->parameters = &parameters;
+        this->settings = &settings;
+        this->training_images = data.training_images;
+        this->pixel_classes = data.pixel_classes;
+        this->foreground_counts = data.foreground_counts;
+        this->band_counts = data.band_counts;
+        this->background_counts = data.background_counts;
+        this->background_color = data.background_color;
+        this->foreground_color = data.foreground_color;
+        this->number_of_labeled_pixels = 0;
+        this->selection_seed = random.next();
+
+        for(unsigned int i = 0; i < training_images.size(); ++i) {
+            // zurückgehaltene Vordergrundpixel zählen auch beim Auswählen der
+            // Hintergrundpixel nicht mit
+            unsigned long from_foreground = foreground_counts[i] - static_cast<unsigned long>(settings.out_of_bag_fraction * foreground_counts[i] + 0.5);
+
+            // wenn es doch mehr Vordergrund- als Hintergrundpixel gibt,
+            // werden auch alle Hintergrundpixel ausgewählt
+            unsigned long from_band = std::min(band_counts[i], from_foreground);
+            unsigned long from_background = std::min(background_counts[i], from_foreground - from_band);
+
+            selected_foreground.push_back(from_foreground);
+            selected_band.push_back(from_band);
+            selected_background.push_back(from_background);
+            number_of_labeled_pixels += from_foreground + from_band + from_background;
+        }
+    }
+};
+
+
+
+// geht alle gelabelten Pixel der Trainingsbilder eines TrainingData-Objekts
+// der Reihe nach durch und sagt für jedes, ob es für den Baum ausgewählt
+// ist. Die Auswahl wird dabei mit selection_seed jedes Mal gleich
+// ausgewürfelt. Beim Auslagern wird so nur in den abgebildeten Pixelklassen
+// gelesen.
+//
+//   for(SelectedPixels pixel(labels); pixel.next(); ) { ... }
+class SelectedPixels
+{
+
+public:
+    // das aktuelle Pixel: Index des Bilds, Position und Label (1 ist
+    // Hintergrund, 2 ist Vordergrund, 0 heißt nicht ausgewählt)
+    unsigned int image;
+    unsigned int x;
+    unsigned int y;
+    unsigned char label;
+
+
+    SelectedPixels(const TrainingData& labels)
+        : labels(labels), random(labels.selection_seed, 0)
+    {
+        image = 0;
+        x = 0;
+        y = 0;
+        label = 0;
+        position = 0;
+        left_foreground = left_band = left_background = 0;
+        needed_foreground = needed_band = needed_background = 0;
+        start_image();
+    }
+
+
+    // geht zum nächsten gelabelten Pixel. Gibt false zurück, wenn es keins
+    // mehr gibt.
+    bool next()
+    {
+        while(image < labels.pixel_classes.size()) {
+            const CImg<unsigned char>& classes = *(labels.pixel_classes[image]);
+            const unsigned long number_of_pixels = classes.size();
+            while(position < number_of_pixels) {
+                unsigned long p = position++;
+                unsigned char c = classes.data()[p];
+                if(c == PIXEL_FOREGROUND) {
+                    label = (take(needed_foreground, left_foreground) ? 2 : 0);
+                } else if(c == PIXEL_BACKGROUND_BAND) {
+                    label = (take(needed_band, left_band) ? 1 : 0);
+                } else if(c == PIXEL_BACKGROUND) {
+                    label = (take(needed_background, left_background) ? 1 : 0);
+                } else {
+                    continue;
+                }
+                x = static_cast<unsigned int>(p % classes.width());
+                y = static_cast<unsigned int>(p / classes.width());
+                return true;
+            }
+            ++image;
+            position = 0;
+            start_image();
+        }
+        return false;
+    }
+
+
+private:
+    const TrainingData& labels;
+    Random random;
+
+    // Position im aktuellen Bild und wieviele Pixel jeder Klasse darin noch
+    // kommen bzw. noch ausgewählt werden
+    unsigned long position;
+    unsigned long left_foreground;
+    unsigned long left_band;
+    unsigned long left_background;
+    unsigned long needed_foreground;
+    unsigned long needed_band;
+    unsigned long needed_background;
+
+
+    void start_image()
+    {
+        if(image >= labels.pixel_classes.size()) {
+            return;
+        }
+        left_foreground = labels.foreground_counts[image];
+        left_band = labels.band_counts[image];
+        left_background = labels.background_counts[image];
+        needed_foreground = labels.selected_foreground[image];
+        needed_band = labels.selected_band[image];
+        needed_background = labels.selected_background[image];
+    }
+
+
+    // Auswahlstichprobe (Knuth, Algorithmus S): jedes Pixel wird mit
+    // Wahrscheinlichkeit (noch benötigt) / (noch übrig) genommen. Das ergibt
+    // in einem Durchlauf genau die gewünschte Anzahl, und jede Teilmenge ist
+    // gleich wahrscheinlich. Werden alle übrigen gebraucht, muss nicht
+    // gewürfelt werden.
+    bool take(unsigned long& needed, unsigned long& left)
+    {
+        bool taken = (needed == left || random.index(left) < needed);
+        if(taken) {
+            --needed;
+        }
+        --left;
+        return taken;
+    }
+
+    SelectedPixels(const SelectedPixels&);
+    SelectedPixels& operator=(const SelectedPixels&);
+};
+
+
+
+// Eine Variante der Trainingsbeispiele für die Augmentierung (siehe
+// TrainingSettings::augmentation_variants). Statt gedrehte, gespiegelte oder
+// im Kontrast veränderte Kopien der Trainingsbilder anzulegen, werden die
+// Offsets und Schwellwerte der Testobjekte umgerechnet, wenn sie auf ein
+// Beispiel dieser Variante angewendet werden (siehe
+// PixelDifferenceTest::augmented). Das
+// ergibt dasselbe, als wäre das Fenster um das Pixel erst gespiegelt, dann
+// gedreht (auf ganze Pixel gerundet, innerhalb des Fensters) und die
+// Grauwerte mit gain multipliziert worden. Ein zusätzlicher Offset auf die
+// Grauwerte würde sich bei Differenzen von zwei Pixeln wegheben und wird
+// deshalb nicht gebraucht.
+class Augmentation
+{
+
+public:
+    bool flip_x;
+    bool flip_y;
+    double cos_angle;
+    double sin_angle;
+    double gain;
+
+    // die gedrehten Offsets werden auf das Fenster mit diesem Radius begrenzt
+    short window_radius;
+
+
+    // die unveränderte Variante
+    Augmentation(unsigned char window_radius)
+    {
+        flip_x = false;
+        flip_y = false;
+        cos_angle = 1.0;
+        sin_angle = 0.0;
+        gain = 1.0;
+        this->window_radius = window_radius;
+    }
+
+
+    static Augmentation sample(unsigned char window_radius, const TrainingSettings& settings, Random& random)
+    {
+        Augmentation augmentation(window_radius);
+        if(settings.augmentation_flips) {
+            augmentation.flip_x = (random.index(2) == 1);
+            augmentation.flip_y = (random.index(2) == 1);
+        }
+        double angle = settings.augmentation_max_angle * cimg::PI / 180.0 * (2.0 * random.uniform() - 1.0);
+        augmentation.cos_angle = cos(angle);
+        augmentation.sin_angle = sin(angle);
+        augmentation.gain = 1.0 + settings.augmentation_max_gain * (2.0 * random.uniform() - 1.0);
+        return augmentation;
+    }
+
+
+    // spiegelt und dreht den Offset (x, y) relativ zum zu klassifizierenden
+    // Pixel. Das Ergebnis bleibt im Fenster.
+    void transform_offset(short& x, short& y) const
+    {
+        double fx = flip_x ? -x : x;
+        double fy = flip_y ? -y : y;
+        int rx = static_cast<int>(floor(cos_angle * fx - sin_angle * fy + 0.5));
+        int ry = static_cast<int>(floor(sin_angle * fx + cos_angle * fy + 0.5));
+        x = static_cast<short>(std::max(-static_cast<int>(window_radius), std::min(static_cast<int>(window_radius), rx)));
+        y = static_cast<short>(std::max(-static_cast<int>(window_radius), std::min(static_cast<int>(window_radius), ry)));
+    }
+};
+
+
+
+// die Schleifen über ein Fenster mit dem Radius Radius, also über
+// (2*Radius + 1)^2 Pixel. Für die üblichen Radien werden sie mit festem
+// Radius instanziiert, dann haben alle Schleifen eine feste Länge und der
+// Compiler kann sie ganz ausrollen. Radius -1 steht für jeden anderen
+// Radius, dann gilt die Fenstergröße window_size, die alle Funktionen
+// übergeben bekommen (siehe WindowFunctions).
+template <int Radius>
+struct FixedWindow
+{
+    static int size(int window_size)
+    {
+        return Radius >= 0 ? 2*Radius + 1 : window_size;
+    }
+
+
+    // kopiert das Fenster mit der linken oberen Ecke corner in einem Bild mit
+    // der Breite width an einem Stück nach target
+    static void copy(int window_size, const unsigned char* corner, int width, unsigned char* target)
+    {
+        window_size = size(window_size);
+        for(int row = 0; row < window_size; ++row, corner += width, target += window_size) {
+            std::copy(corner, corner + window_size, target);
+        }
+    }
+
+
+    // führt den FNV-1a-Hash hash über das Fenster fort
+    static unsigned long long hash(int window_size, const unsigned char* corner, int width, unsigned long long hash)
+    {
+        window_size = size(window_size);
+        for(int row = 0; row < window_size; ++row, corner += width) {
+            for(int column = 0; column < window_size; ++column) {
+                hash = (hash ^ corner[column]) * 1099511628211ULL;
+            }
+        }
+        return hash;
+    }
+
+
+    static bool equal(int window_size, const unsigned char* corner1, int width1, const unsigned char* corner2, int width2)
+    {
+        window_size = size(window_size);
+        for(int row = 0; row < window_size; ++row, corner1 += width1, corner2 += width2) {
+            if(!std::equal(corner1, corner1 + window_size, corner2)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    // vertauscht zwei zusammenhängend gespeicherte Fenster
+    static void swap(int window_size, unsigned char* window1, unsigned char* window2)
+    {
+        const int window_bytes = size(window_size) * size(window_size);
+        std::swap_ranges(window1, window1 + window_bytes, window2);
+    }
+};
+
+
+
+// die Funktionen von FixedWindow für den Radius, mit dem gerade trainiert
+// wird. select wählt die Instanz einmal pro SampleStore aus, danach wird nur
+// noch über die Zeiger aufgerufen.
+struct WindowFunctions
+{
+    void (*copy)(int, const unsigned char*, int, unsigned char*);
+    unsigned long long (*hash)(int, const unsigned char*, int, unsigned long long);
+    bool (*equal)(int, const unsigned char*, int, const unsigned char*, int);
+    void (*swap)(int, unsigned char*, unsigned char*);
+
+
+    template <int Radius>
+    static WindowFunctions of()
+    {
+        WindowFunctions functions;
+        functions.copy = &FixedWindow<Radius>::copy;
+        functions.hash = &FixedWindow<Radius>::hash;
+        functions.equal = &FixedWindow<Radius>::equal;
+        functions.swap = &FixedWindow<Radius>::swap;
+        return functions;
+    }
+
+
+    static WindowFunctions select(unsigned int radius)
+    {
+        switch(radius) {
+            case 2: return of<2>();
+            case 3: return of<3>();
+            case 4: return of<4>();
+            case 5: return of<5>();
+            case 6: return of<6>();
+            case 7: return of<7>();
+            case 8: return of<8>();
+            default: return of<-1>();
+        }
+    }
+};
+
+
+
+// Die Trainingsbeispiele eines Baums. Jedes Beispiel wird als eine 64-Bit-Zahl
+// gespeichert: in den oberen 16 Bit der Index des Trainingsbilds, darunter
+// 4 Bit mit der Variante für die Augmentierung (siehe Augmentation), 11 Bit
+// mit dem Gewicht minus 1 (siehe deduplicate), 32 Bit mit dem linearen Index
+// des Pixels im Bild und im untersten Bit das Label (1 für Vordergrund). Beim Umsortieren der Beispiele muss so nur eine Zahl pro
+// Beispiel vertauscht werden. Alle Anzahlen beim Training sind Summen der
+// Gewichte.
+//
+// Wenn TrainingSettings::copy_sample_windows gesetzt ist, wird zusätzlich das
+// Fenster um jedes Pixel in einen zusammenhängenden Puffer kopiert (in
+// derselben Reihenfolge wie die Beispiele). Dann laufen die Auswertung der
+// Testobjekte und das Umsortieren linear durch den Speicher, statt kreuz und
+// quer in den Trainingsbildern herumzuspringen. Beim Auslagern
+// (TrainingSettings::out_of_core_prefix) liegen die Beispiele, dieser Puffer
+// und alle Zwischenspeicher pro Beispiel in Speicher abgebildeten Dateien
+// (siehe SampleBuffer).
+class SampleStore
+{
+public:
+    typedef unsigned long long Key;
+
+    SampleBuffer<Key> keys;
+    unsigned char* windows;
+    bool with_windows;
+
+    // die Parameter des Walds, dessen Baum mit diesen Beispielen trainiert
+    // wird, und die Einstellungen des Trainings
+    const ForestParameters* parameters;
+    const TrainingSettings* settings;
+
+    // der Zufallsgenerator des Baums (aus TrainingData)
+    Random* random;
+
+    // Größe, Fläche und Schleifen der Fenster, damit die heißen Schleifen
+    // nicht bei jedem Beispiel in parameters nachsehen
+    int window_size;
+    unsigned int window_radius;
+    unsigned int window_bytes;
+    WindowFunctions window_functions;
+
+    // hier liegen die Fenster
+    SampleBuffer<unsigned char> window_buffer;
+
+    std::vector<CImg<unsigned char>*> images;
+
+    // für jede Quelle der Zeilenabstand im Speicher und die Variante der
+    // Augmentierung. Eine Quelle ist ein Trainingsbild (oder der Puffer mit
+    // den kopierten Fenstern, dann ist der Zeilenabstand window_size)
+    // zusammen mit einer Variante; ohne Augmentierung gibt es nur die
+    // unveränderte.
+    std::vector<int> strides;
+    std::vector<Augmentation> augmentations;
+
+    // Zwischenspeicher für die Suche nach dem besten Testobjekt eines Knotens
+    // (siehe Node::evaluate_block und partition_samples): pro Beispiel die
+    // Ergebnisse aller Testobjekte des gerade bewerteten Blocks als Bits und
+    // ob das bisher beste Testobjekt das Beispiel nach links schickt, dazu
+    // Platz für die Beispiele einer Seite beim Aufteilen (bei kopierten
+    // Fenstern auch für deren Fenster), außerdem die aufsummierten Gewichte
+    // für Node::preselect_candidates. Die Puffer werden erst bei Bedarf
+    // angelegt (siehe allocate_buffer).
+    SampleBuffer<unsigned int> block_outcomes;
+    SampleBuffer<unsigned char> goes_left;
+    SampleBuffer<Key> partition_buffer;
+    SampleBuffer<unsigned char> partition_windows;
+    SampleBuffer<unsigned long> cumulative_weights;
+
+
+    SampleStore(TrainingData& training)
+    {
+        const bool copy_windows = training.settings->copy_sample_windows;
+        this->images = training.training_images;
+        this->with_windows = copy_windows;
+        this->windows = NULL;
+        this->parameters = training.parameters;
+        this->settings = training.settings;
+        this->random = &training.random;
+        this->window_size = parameters->window_size;
+        this->window_radius = parameters->window_radius;
+        this->window_bytes = window_size * window_size;
+        this->window_functions = WindowFunctions::select(window_radius);
+
+        for(unsigned int i = 0; i < images.size(); ++i) {
+            if(images[i]->size() > 0xffffffffUL) {
+                std::cerr << "Fehler: Trainingsbilder dürfen höchstens 2^32 Pixel haben" << std::endl;
+                std::exit(1);
+            }
+        }
+
+        unsigned int variants = std::max(1u, std::min(settings->augmentation_variants, 16u));
+        std::vector<Augmentation> variant_augmentations(1, Augmentation(window_radius));
+        for(unsigned int v = 1; v < variants; ++v) {
+            variant_augmentations.push_back(Augmentation::sample(window_radius, *settings, *random));
+        }
+        for(unsigned int v = 0; v < variants; ++v) {
+            if(copy_windows) {
+                strides.push_back(window_size);
+                augmentations.push_back(variant_augmentations[v]);
+            } else {
+                for(unsigned int i = 0; i < images.size(); ++i) {
+                    strides.push_back(images[i]->width());
+                    augmentations.push_back(variant_augmentations[v]);
+                }
+            }
+        }
+
+        // am Rand der Bilder liegen keine gelabelten Pixel (siehe
+        // LabeledImages), das Fenster passt also immer ins Bild
+        allocate_buffer(keys, training.number_of_labeled_pixels, ".beispiele");
+        unsigned long number_of_samples = 0;
+        for(SelectedPixels pixel(training); pixel.next(); ) {
+            if(pixel.label > 0) {
+                Key index = static_cast<Key>(pixel.y) * images[pixel.image]->width() + pixel.x;
+                Key variant = (variants > 1 ? random->index(variants) : 0);
+                keys[number_of_samples++] = (static_cast<Key>(pixel.image) << 48) | (variant << 44) | (index << 1) | static_cast<Key>(pixel.label - 1);
+            }
+        }
+        keys.shrink(number_of_samples);
+
+        if(settings->deduplicate_samples) {
+            deduplicate();
+        }
+
+        if(copy_windows) {
+            allocate_buffer(window_buffer, keys.size() * window_bytes, ".fenster");
+            windows = window_buffer.begin();
+            for(size_t i = 0; i < keys.size(); ++i) {
+                window_functions.copy(window_size, image_corner(i), images[keys[i] >> 48]->width(), &windows[i * window_bytes]);
+            }
+        }
+    }
+
+
+    // Auf einheitlichen Flächen (leeres Papier, Füllungen) haben viele
+    // Beispiele genau dasselbe Fenster. Jedes Testobjekt schickt sie alle auf
+    // dieselbe Seite, also reicht es, eins davon mit der Anzahl als Gewicht
+    // zu behalten; die gelernten Testobjekte und Anzahlen bleiben dieselben.
+    // Dazu wird für jedes Beispiel ein FNV-1a-Hash über Fenster, Label und
+    // Variante berechnet. Nach dem Sortieren der Hashes werden Beispiele mit gleichem
+    // Hash noch einmal Byte für Byte verglichen. Es bleibt jeweils das erste
+    // Beispiel stehen, die Reihenfolge der übrigen ändert sich nicht. Passt
+    // das Gewicht nicht mehr in 11 Bit, wird ein neues Beispiel angefangen.
+    // Die Hashes und Gewichte (24 Byte pro Beispiel) liegen auch beim
+    // Auslagern im Arbeitsspeicher, solange die Funktion läuft.
+    void deduplicate()
+    {
+        const unsigned long max_weight = 0x800;
+
+        std::vector<std::pair<unsigned long long, unsigned long> > hashes(keys.size());
+        for(unsigned long i = 0; i < keys.size(); ++i) {
+            unsigned long long hash = window_functions.hash(window_size, image_corner(i), images[keys[i] >> 48]->width(), 14695981039346656037ULL);
+            hash = (hash ^ is_foreground(i)) * 1099511628211ULL;
+            hash = (hash ^ variant(i)) * 1099511628211ULL;
+            hashes[i] = std::make_pair(hash, i);
+        }
+        std::sort(hashes.begin(), hashes.end());
+
+        // für jedes Beispiel das Gewicht, 0 heißt, dass es wegfällt
+        std::vector<unsigned long> weights(keys.size(), 1);
+        // die Beispiele, die in der aktuellen Gruppe mit gleichem Hash stehen
+        // bleiben
+        std::vector<unsigned long> kept;
+        for(size_t h = 0; h < hashes.size(); ++h) {
+            if(h == 0 || hashes[h].first != hashes[h-1].first) {
+                kept.clear();
+            }
+            unsigned long i = hashes[h].second;
+            for(size_t k = 0; k < kept.size(); ++k) {
+                if(weights[kept[k]] < max_weight && same_sample(kept[k], i)) {
+                    weights[kept[k]] += 1;
+                    weights[i] = 0;
+                    break;
+                }
+            }
+            if(weights[i] != 0) {
+                kept.push_back(i);
+            }
+        }
+
+        unsigned long merged = 0;
+        for(unsigned long i = 0; i < keys.size(); ++i) {
+            if(weights[i] != 0) {
+                keys[merged] = keys[i] | (static_cast<Key>(weights[i] - 1) << 33);
+                ++merged;
+            }
+        }
+
+#pragma omp critical(output)
+        std::cout << keys.size() << " Trainingsbeispiele zu " << merged << " zusammengefasst" << std::endl;
+
+        keys.shrink(merged);
+    }
+
+
+    // legt einen Puffer mit length Einträgen an, beim Auslagern in einer
+    // Datei, deren Name mit dem Präfix und suffix beginnt (siehe
+    // MappedFile::create_temporary)
+    template <typename V>
+    void allocate_buffer(SampleBuffer<V>& buffer, size_t length, const char* suffix)
+    {
+        std::string filename;
+        if(!settings->out_of_core_prefix.empty()) {
+            filename = settings->out_of_core_prefix + suffix;
+        }
+        buffer.allocate(length, filename);
+    }
+
+
+    // legt die Puffer für die Ergebnisse der Testobjekte an. Die Knoten
+    // einer Ebene werden parallel bewertet und aufgeteilt, deshalb geschieht
+    // das dort vorher (siehe Tree::train_levelwise).
+    void allocate_outcome_buffers()
+    {
+        if(block_outcomes.size() < size()) {
+            allocate_buffer(block_outcomes, size(), ".ergebnisse");
+            allocate_buffer(goes_left, size(), ".links");
+        }
+    }
+
+
+    // ebenso für partition_samples. Die kleinere Seite eines Knotens hat
+    // höchstens halb so viele Beispiele wie der Knoten, deshalb reicht Platz
+    // für halb so viele Fenster, wie es Beispiele gibt.
+    void allocate_partition_buffers()
+    {
+        if(partition_buffer.size() < size()) {
+            allocate_buffer(partition_buffer, size(), ".rechts");
+            if(with_windows) {
+                allocate_buffer(partition_windows, (size() / 2 + 1) * window_bytes, ".rechtsfenster");
+            }
+        }
+    }
+
+
+    // ob die Beispiele i und j dasselbe Label, dieselbe Variante und dasselbe
+    // Fenster haben
+    bool same_sample(unsigned long i, unsigned long j)
+    {
+        if(is_foreground(i) != is_foreground(j) || variant(i) != variant(j)) {
+            return false;
+        }
+        return window_functions.equal(window_size, image_corner(i), images[keys[i] >> 48]->width(), image_corner(j), images[keys[j] >> 48]->width());
+    }
+
+
+    // Zeiger auf die linke obere Ecke des Fensters von Beispiel i im
+    // Trainingsbild
+    const unsigned char* image_corner(unsigned long i)
+    {
+        CImg<unsigned char>& image = *(images[keys[i] >> 48]);
+        return image.data() + pixel_index(i) - window_radius * image.width() - window_radius;
+    }
+
+
+    unsigned long size()
+    {
+        return keys.size();
+    }
+
+
+    unsigned long is_foreground(unsigned long i)
+    {
+        return static_cast<unsigned long>(keys[i] & 1);
+    }
+
+
+    unsigned long pixel_index(unsigned long i)
+    {
+        return static_cast<unsigned long>((keys[i] & 0x1ffffffffULL) >> 1);
+    }
+
+
+    // wie viele gleiche Trainingspixel das Beispiel i vertritt
+    unsigned long weight(unsigned long i)
+    {
+        return static_cast<unsigned long>((keys[i] >> 33) & 0x7ff) + 1;
+    }
+
+
+    // die Variante der Augmentierung für das Beispiel i
+    unsigned int variant(unsigned long i)
+    {
+        return static_cast<unsigned int>((keys[i] >> 44) & 0xf);
+    }
+
+
+    // zählt die Beispiele im Intervall [from, to] und wieviele davon
+    // Vordergrundpixel sind (jeweils mit Gewicht)
+    void count(unsigned long from, unsigned long to, unsigned long& total, unsigned long& foreground)
+    {
+        total = 0;
+        foreground = 0;
+        for(unsigned long i = from; i <= to; ++i) {
+            unsigned long w = weight(i);
+            total += w;
+            foreground += is_foreground(i) * w;
+        }
+    }
+
+
+    // Index der Quelle (in strides und augmentations), die für das Beispiel
+    // i gilt
+    unsigned int source(unsigned long i)
+    {
+        if(with_windows) {
+            return variant(i);
+        }
+        return variant(i) * images.size() + static_cast<unsigned int>(keys[i] >> 48);
+    }
+
+
+    // Zeiger auf das Pixel, das das Beispiel i darstellt. Die Nachbarpixel
+    // erreicht man über den Zeilenabstand strides[source(i)].
+    const unsigned char* center(unsigned long i)
+    {
+        if(with_windows) {
+            return &windows[i * window_bytes + window_bytes / 2];
+        }
+        return images[keys[i] >> 48]->data() + pixel_index(i);
+    }
+
+
+    void swap(unsigned long i, unsigned long j)
+    {
+        std::swap(keys[i], keys[j]);
+        if(with_windows) {
+            window_functions.swap(window_size, windows + i * window_bytes, windows + j * window_bytes);
+        }
+    }
+};
+
+
+
+// jeder Blattknoten der Entscheidungsbäume hat einen Zeiger auf so ein
+// LeafInfo-Objekt. Es enthält einfach die (empirische) Wahrscheinlichkeit,
+// dass das Pixel, das an diesem Blattknoten ankommt, ein Vordergrundpixel ist
+//
+// Außerdem werden die Anzahlen der Trainingspixel gespeichert, aus denen die
+// Wahrscheinlichkeit berechnet wurde. Damit kann man die Blätter später mit
+// neuen Labelbildern nachtrainieren (siehe Forest::refit). In der JSON-Datei
+// ist ein Blatt dann [Vordergrundpixel, Pixel insgesamt]; ältere Modelle
+// enthalten nur die Wahrscheinlichkeit, dann sind beide Anzahlen 0.
+//
+// Auch die inneren Knoten haben ein LeafInfo-Objekt mit den Anzahlen der
+// Pixel, die dort ankommen. So kann man einen Baum nachträglich auf eine
+// geringere Tiefe abschneiden (siehe Node::truncate).
+class LeafInfo
+{
+
+public:
+    double foreground_probability;
+    unsigned long foreground_count;
+    unsigned long total_count;
+
+    // berechnet foreground_probability neu aus den Anzahlen. Ohne Pixel
+    // bleibt die alte Wahrscheinlichkeit stehen.
+    void update_probability()
+    {
+        if(total_count > 0) {
+            foreground_probability = static_cast<double>(foreground_count) / static_cast<double>(total_count);
+        }
+    }
+
+    JSONValue* to_json()
+    {
+        if(total_count == 0) {
+            return new JSONValue(foreground_probability);
+        }
+        JSONArray array;
+        array.push_back(new JSONValue(static_cast<double>(foreground_count)));
+        array.push_back(new JSONValue(static_cast<double>(total_count)));
+        return new JSONValue(array);
+    }
+
+    static LeafInfo from_json(JSONValue* value)
+    {
+        LeafInfo new_leafinfo;
+        if(value->IsArray()) {
+            JSONArray array = value->AsArray();
+            new_leafinfo.foreground_count = static_cast<unsigned long>(array[0]->AsNumber());
+            new_leafinfo.total_count = static_cast<unsigned long>(array[1]->AsNumber());
+            new_leafinfo.foreground_probability = 0.0;
+            new_leafinfo.update_probability();
+        } else {
+            new_leafinfo.foreground_probability = value->AsNumber();
+            new_leafinfo.foreground_count = 0;
+            new_leafinfo.total_count = 0;
+        }
+        return new_leafinfo;
+    }
+};
+
+
+
+
+// jeder innere Knoten eines Entscheidungsbaums hat einen Zeiger auf ein
+// Testobjekt, das (mit der Funktion goes_left()) ein Pixel entweder nach links
+// oder nach rechts im Entscheidungsbaum weiterschickt
+
+// Hier werden 3 verschiedene Varianten solcher Klassen definiert, aber nur
+// PixelDifferenceTest wird verwendet. Die anderen beiden kann man zum debuggen
+// verwenden.
+
+
+// so ein Testobjekt testet, ob der Unterschied der Grauwerte von zwei
+// bestimmten Pixeln in der Nachbarschaft des zu klassifizierenden Pixels
+// kleiner oder größer als ein Schwellwert ist
+class PixelDifferenceTest
+{
+public:
+    short offset_pixel1_x;
+    short offset_pixel1_y;
+    short offset_pixel2_x;
+    short offset_pixel2_y;
+    short difference_threshold;
+
+    // Index des Offset-Paars im Offset-Pool des Walds
+    // (ForestParameters::offset_pool) oder -1, wenn die Offsets nicht aus
+    // dem Pool sind
+    short pool_index;
+
+    static std::wstring name;
+
+
+    bool goes_left(CImg<unsigned char>* image, unsigned int x, unsigned int y)
+    {
+        return ((*image)(x + offset_pixel1_x, y + offset_pixel1_y) - (*image)(x + offset_pixel2_x, y + offset_pixel2_y)) < difference_threshold;
+    }
+
+
+    // wie oben, aber für ein Pixel, auf das center zeigt, in einem Bild
+    // (oder Fenster) mit dem Zeilenabstand stride
+    bool goes_left(const unsigned char* center, int stride)
+    {
+        return (center[offset_pixel1_y * stride + offset_pixel1_x] - center[offset_pixel2_y * stride + offset_pixel2_x]) < difference_threshold;
+    }
+
+
+    // die Differenz selbst, z.B. als Schwellwert für einen Farn (siehe
+    // Fern::train)
+    short difference(const unsigned char* center, int stride)
+    {
+        return center[offset_pixel1_y * stride + offset_pixel1_x] - center[offset_pixel2_y * stride + offset_pixel2_x];
+    }
+
+
+    // das Testobjekt, das auf ein Beispiel mit der Variante augmentation
+    // angewendet werden muss: gespiegelte und gedrehte Offsets, und weil die
+    // Differenz mit gain multipliziert wird, ist d * gain < t dasselbe wie
+    // d < t / gain (für ganzzahlige d: d < ceil(t / gain))
+    PixelDifferenceTest augmented(const Augmentation& augmentation) const
+    {
+        PixelDifferenceTest testobject = *this;
+        augmentation.transform_offset(testobject.offset_pixel1_x, testobject.offset_pixel1_y);
+        augmentation.transform_offset(testobject.offset_pixel2_x, testobject.offset_pixel2_y);
+        testobject.difference_threshold = static_cast<short>(ceil(difference_threshold / augmentation.gain));
+        return testobject;
+    }
+
+
+    // ein Block von Testobjekten für das Training. Er wird erst nach der
+    // Klasse definiert, weil er die Testobjekte selbst enthält.
+    class Block;
+
+
+    // ein Testobjekt wird erzeugt, indem einfach zufällig innerhalb kleinen
+    // Fenster rund um ein Pixel zwei Nachbarpositionen und der Schwellwert
+    // ausgewürfelt werden. Mit Offset-Pool wird nur eines der Paare daraus
+    // ausgewählt.
+    static PixelDifferenceTest sample(const ForestParameters& parameters, Random& random)
+    {
+        PixelDifferenceTest testobject;
+        if(parameters.offset_pool.empty()) {
+            testobject.offset_pixel1_x = random.index(parameters.window_size) - parameters.window_radius;
+            testobject.offset_pixel1_y = random.index(parameters.window_size) - parameters.window_radius;
+            testobject.offset_pixel2_x = random.index(parameters.window_size) - parameters.window_radius;
+            testobject.offset_pixel2_y = random.index(parameters.window_size) - parameters.window_radius;
+            testobject.pool_index = -1;
+        } else {
+            testobject.set_pool_offsets(static_cast<short>(random.index(parameters.offset_pool.size() / 4)), parameters.offset_pool);
+        }
+        testobject.difference_threshold = static_cast<short>(random.index(511)) - 255;
+        return testobject;
+    }
+
+
+    // übernimmt die Offsets des Paars pool_index aus offset_pool
+    void set_pool_offsets(short pool_index, const std::vector<short>& offset_pool)
+    {
+        this->pool_index = pool_index;
+        offset_pixel1_x = offset_pool[4*pool_index];
+        offset_pixel1_y = offset_pool[4*pool_index + 1];
+        offset_pixel2_x = offset_pool[4*pool_index + 2];
+        offset_pixel2_y = offset_pool[4*pool_index + 3];
+    }
+
+
+    // würfelt den Offset-Pool für einen Wald aus, genauso wie die Offsets in
+    // sample()
+    static void draw_offset_pool(ForestParameters& parameters, unsigned int size, Random& random)
+    {
+        parameters.offset_pool.resize(4*size);
+        for(size_t i = 0; i < parameters.offset_pool.size(); ++i) {
+            parameters.offset_pool[i] = random.index(parameters.window_size) - parameters.window_radius;
+        }
+    }
+
+
+    JSONValue* to_json()
+    {
+        JSONArray array;
+        array.push_back(new JSONValue(static_cast<double>(offset_pixel1_x)));
+        array.push_back(new JSONValue(static_cast<double>(offset_pixel1_y)));
+        array.push_back(new JSONValue(static_cast<double>(offset_pixel2_x)));
+        array.push_back(new JSONValue(static_cast<double>(offset_pixel2_y)));
+        array.push_back(new JSONValue(static_cast<double>(difference_threshold)));
+        return new JSONValue(array);
+    }
+
+
+    static PixelDifferenceTest from_json(JSONValue* value, const ForestParameters& parameters)
+    {
+        JSONArray array = value->AsArray();
+        PixelDifferenceTest testobject;
+        testobject.offset_pixel1_x = static_cast<short>(array[0]->AsNumber());
+        testobject.offset_pixel1_y = static_cast<short>(array[1]->AsNumber());
+        testobject.offset_pixel2_x = static_cast<short>(array[2]->AsNumber());
+        testobject.offset_pixel2_y = static_cast<short>(array[3]->AsNumber());
+        testobject.difference_threshold = static_cast<short>(array[4]->AsNumber());
+
+        // das Modell speichert nur die Offsets, der Index im Pool wird
+        // wieder gesucht
+        const std::vector<short>& pool = parameters.offset_pool;
+        testobject.pool_index = -1;
+        for(size_t i = 0; i < pool.size(); i += 4) {
+            if(pool[i] == testobject.offset_pixel1_x && pool[i + 1] == testobject.offset_pixel1_y &&
+                    pool[i + 2] == testobject.offset_pixel2_x && pool[i + 3] == testobject.offset_pixel2_y) {
+                testobject.pool_index = static_cast<short>(i / 4);
+                break;
+            }
+        }
+        return testobject;
+    }
+};
+
+
+// schreibt offset_pool als Liste von [x1, y1, x2, y2] in die Lernparameter
+void offset_pool_to_json(JSONObject& learning_parameters, const std::vector<short>& offset_pool)
+{
+    JSONArray pool;
+    for(size_t i = 0; i < offset_pool.size(); i += 4) {
+        JSONArray pair;
+        for(size_t j = i; j < i + 4; ++j) {
+            pair.push_back(new JSONValue(static_cast<double>(offset_pool[j])));
+        }
+        pool.push_back(new JSONValue(pair));
+    }
+    learning_parameters[L"Offset pool"] = new JSONValue(pool);
+}
+
+
+// liest offset_pool aus den Lernparametern; ohne Pool wird er geleert
+void offset_pool_from_json(JSONObject& learning_parameters, std::vector<short>& offset_pool)
+{
+    offset_pool.clear();
+    JSONObject::iterator it = learning_parameters.find(L"Offset pool");
+    if(it == learning_parameters.end()) {
+        return;
+    }
+    JSONArray pool = it->second->AsArray();
+    for(size_t i = 0; i < pool.size(); ++i) {
+        JSONArray pair = pool[i]->AsArray();
+        for(size_t j = 0; j < 4; ++j) {
+            offset_pool.push_back(static_cast<short>(pair[j]->AsNumber()));
+        }
+    }
+}
+
+// Ein Block von mehreren Testobjekten, die beim Training gemeinsam auf
+// jeweils ein Trainingsbeispiel angewendet werden (siehe
+// Node::build_inner_node). Die Offsets werden für jedes Bild (bzw.
+// Fenster) einmal in lineare Abstände im Speicher umgerechnet, damit die
+// innere Schleife ohne Multiplikationen und Verzweigungen auskommt und
+// der Compiler sie vektorisieren kann.
+class PixelDifferenceTest::Block
+{
+public:
+    static const unsigned int MAX_SIZE = 32;
+
+    unsigned int size;
+    PixelDifferenceTest tests[MAX_SIZE];
+
+    // für jede Quelle (siehe SampleStore::strides) MAX_SIZE lineare
+    // Offsets von Pixel 1 bzw. Pixel 2 relativ zum zu klassifizierenden
+    // Pixel und MAX_SIZE Schwellwerte, jeweils schon für die Variante der
+    // Augmentierung umgerechnet
+    std::vector<int> linear_offsets1;
+    std::vector<int> linear_offsets2;
+    std::vector<int> thresholds;
+
+
+    void prepare(std::vector<int>& strides, std::vector<Augmentation>& augmentations)
+    {
+        linear_offsets1.assign(strides.size() * MAX_SIZE, 0);
+        linear_offsets2.assign(strides.size() * MAX_SIZE, 0);
+        thresholds.assign(strides.size() * MAX_SIZE, 0);
+        for(unsigned int i = 0; i < strides.size(); ++i) {
+            int width = strides[i];
+            for(unsigned int j = 0; j < size; ++j) {
+                PixelDifferenceTest test = tests[j].augmented(augmentations[i]);
+                linear_offsets1[i*MAX_SIZE + j] = test.offset_pixel1_y * width + test.offset_pixel1_x;
+                linear_offsets2[i*MAX_SIZE + j] = test.offset_pixel2_y * width + test.offset_pixel2_x;
+                thresholds[i*MAX_SIZE + j] = test.difference_threshold;
+            }
+        }
+    }
+
+
+    // wendet alle Testobjekte des Blocks auf das Pixel an, auf das center
+    // zeigt, und zählt für jedes Testobjekt mit, wie viele Beispiele (und
+    // davon Vordergrundpixel) es nach links schickt. Das Beispiel zählt
+    // weight-mal, als Vordergrundpixel foreground_weight-mal (0 bei
+    // Hintergrundpixeln). Gibt die Ergebnisse als Bits zurück (Bit j ist 1,
+    // wenn Testobjekt j nach links schickt).
+    unsigned int count_left(unsigned int source, const unsigned char* center, unsigned long weight, unsigned long foreground_weight, unsigned long* total_left, unsigned long* foreground_left)
+    {
+        const int* offsets1 = &linear_offsets1[source * MAX_SIZE];
+        const int* offsets2 = &linear_offsets2[source * MAX_SIZE];
+        const int* source_thresholds = &thresholds[source * MAX_SIZE];
+        unsigned int outcomes = 0;
+        for(unsigned int j = 0; j < size; ++j) {
+            unsigned long left = (center[offsets1[j]] - center[offsets2[j]]) < source_thresholds[j];
+            total_left[j] += left * weight;
+            foreground_left[j] += left * foreground_weight;
+            outcomes |= static_cast<unsigned int>(left) << j;
+        }
+        return outcomes;
+    }
+
+
+    // entfernt die Testobjekte, für die keep false ist, aus dem Block.
+    // Die Reihenfolge der übrigen bleibt erhalten.
+    void compact(const bool* keep)
+    {
+        unsigned int sources = linear_offsets1.size() / MAX_SIZE;
+        unsigned int kept = 0;
+        for(unsigned int j = 0; j < size; ++j) {
+            if(keep[j]) {
+                tests[kept] = tests[j];
+                for(unsigned int s = 0; s < sources; ++s) {
+                    linear_offsets1[s*MAX_SIZE + kept] = linear_offsets1[s*MAX_SIZE + j];
+                    linear_offsets2[s*MAX_SIZE + kept] = linear_offsets2[s*MAX_SIZE + j];
+                    thresholds[s*MAX_SIZE + kept] = thresholds[s*MAX_SIZE + j];
+                }
+                ++kept;
+            }
+        }
+        size = kept;
+    }
+};
+
+// statische Member müssen in C++ immer außerhalb der Klasse definiert werden ...
+std::wstring PixelDifferenceTest::name = L"PixelDifferenceTest";
+
+
+
+/*
+// zwei weitere Testfunktionen, die eventuell zum Debuggen nützlich sind
+
+// so ein Testobjekt beachtet die Nachbarpixel überhaupt nicht, sondern testet
+// einfach, ob das zu klassifizierende Pixel größer oder kleiner als ein
+// Schwellwert ist
+class PixelValueTest
+{
+public:
+    unsigned char threshold;
+    static std::wstring name;
+
+    bool goes_left(CImg<unsigned char>* image, unsigned int x, unsigned int y)
+    {
+        return (*image)(x, y) < threshold;
+    }
+
+    static PixelValueTest sample(const ForestParameters& parameters, Random& random)
+    {
+        PixelValueTest testobject;
+        testobject.threshold = random.index(256);
+        return testobject;
+    }
+
+    JSONValue* to_json()
+    {
+        return new JSONValue(static_cast<double>(threshold));
+    }
+};
+
+std::wstring PixelValueTest::name = L"PixelValueTest";
+
+
+
+// so ein Testobjekt testet, ob ein bestimmtes Pixel inder Nachbarschaft heller
+// oder dunkler als ein Schwellwert ist
+class AxisAlignedTest
+{
+public:
+
+    short offset_x;
+    short offset_y;
+    unsigned char threshold;
+    static std::wstring name;
+
+    bool goes_left(CImg<unsigned char>* image, unsigned int x, unsigned int y)
+    {
+        return (*image)(x + offset_x, y + offset_y) < threshold;
+    }
+
+    static AxisAlignedTest sample(const ForestParameters& parameters, Random& random)
+    {
+        AxisAlignedTest testobject;
+        testobject.offset_x = random.index(parameters.window_size) - parameters.window_radius;
+        testobject.offset_y = random.index(parameters.window_size) - parameters.window_radius;
+        testobject.threshold = random.index(256);
+        return testobject;
+    }
+
+
+    JSONValue* to_json()
+    {
+        JSONArray array;
+        array.push_back(new JSONValue(static_cast<double>(offset_x)));
+        array.push_back(new JSONValue(static_cast<double>(offset_y)));
+        array.push_back(new JSONValue(static_cast<double>(threshold)));
+        return new JSONValue(array);
+    }
+
+};
+
+std::wstring AxisAlignedTest::name = L"AxisAlignedTest";
+
+*/
+
+
+
+
+
+
+// die Entropie der Verteilung von Vorder- und Hintergrund, wenn ein
+// Beispiel mit Wahrscheinlichkeit p ein Vordergrundpixel ist
+double binary_entropy(double p)
+{
+    if(p <= 0.0 || p >= 1.0) {
+        return 0.0;
+    }
+#ifdef _WIN32
+    // unter Windows gibts die Funktion log2() nicht
+    return - ((p * log(p) + (1.0 - p) * log(1.0 - p)) / log(2.0));
+#else
+    return - (p * log2(p) + (1.0 - p) * log2(1.0 - p));
+#endif
+}
+
+
+// dieselbe Entropie unter total Beispielen, von denen foreground
+// Vordergrundpixel sind
+double binary_entropy(unsigned long foreground, unsigned long total)
+{
+    if(foreground == 0 || foreground >= total) {
+        return 0.0;
+    }
+    return binary_entropy(static_cast<double>(foreground) / total);
+}
+
+
+// Konfidenzintervall [low, high] für eine Wahrscheinlichkeit, die aus hits
+// Treffern bei draws unabhängigen Ziehungen geschätzt wird. Nach der
+// empirischen Bernstein-Ungleichung (Maurer und Pontil, 2009) liegt sie mit
+// Wahrscheinlichkeit 1 - delta darin, wobei log_term = ln(2 / delta). Weil
+// die Schranke die Varianz der Stichprobe benutzt, wird das Intervall bei
+// Wahrscheinlichkeiten nahe 0 oder 1 viel schmaler als mit Hoeffding.
+void probability_interval(unsigned long hits, unsigned long draws, double log_term, double& low, double& high)
+{
+    low = 0.0;
+    high = 1.0;
+    if(draws < 2) {
+        return;
+    }
+    double m = static_cast<double>(draws);
+    double p = hits / m;
+    double variance = p * (1.0 - p) * m / (m - 1.0);
+    double radius = sqrt(2.0 * variance * log_term / m) + 7.0 * log_term / (3.0 * (m - 1.0));
+    low = std::max(0.0, p - radius);
+    high = std::min(1.0, p + radius);
+}
+
+
+
+// schreibt die Herkunft der Bäume (siehe ForestParameters::has_tree_origin)
+// in die Lernparameter, wenn sie bekannt ist
+void tree_origin_to_json(JSONObject& learning_parameters, const ForestParameters& parameters)
+{
+    if(parameters.has_tree_origin) {
+        learning_parameters[L"Random seed"] = new JSONValue(static_cast<double>(parameters.random_seed));
+        learning_parameters[L"First tree index"] = new JSONValue(static_cast<double>(parameters.first_tree_index));
+    }
+}
+
+
+// liest die Herkunft der Bäume aus den Lernparametern
+void tree_origin_from_json(JSONObject& learning_parameters, ForestParameters& parameters)
+{
+    JSONObject::iterator seed = learning_parameters.find(L"Random seed");
+    JSONObject::iterator index = learning_parameters.find(L"First tree index");
+    parameters.has_tree_origin = (seed != learning_parameters.end() && index != learning_parameters.end());
+    parameters.random_seed = (parameters.has_tree_origin ? static_cast<unsigned int>(seed->second->AsNumber()) : 0);
+    parameters.first_tree_index = (parameters.has_tree_origin ? static_cast<unsigned int>(index->second->AsNumber()) : 0);
+}
+
+
+
+// Parameter für die Vorauswahl der Testobjekte auf Stichproben (siehe
+// Node::preselect_candidates). Bei höchstens SUBSAMPLE_FINALISTS übrigen
+// Testobjekten lohnt eine größere Stichprobe nicht mehr.
+const unsigned long SUBSAMPLE_START_SIZE = 1000;
+const unsigned int SUBSAMPLE_FINALISTS = 8;
+const double SUBSAMPLE_DELTA = 1e-6;
+
+// nach wievielen Trainingsbeispielen jeweils geprüft wird, ob ein Testobjekt
+// noch besser als das bisher beste werden kann (siehe Node::evaluate_block)
+const unsigned long ENTROPY_BOUND_INTERVAL = 1024;
+
+// wie oft beim Training eines Dschungels die Testobjekte und die Zuordnung
+// zu den Kindknoten abwechselnd verbessert werden (siehe Tree::train_jungle)
+const unsigned int JUNGLE_ITERATIONS = 2;
+
+
+
+// die nicht normalisierte Entropie von total Beispielen, davon foreground
+// Vordergrundpixel, so wie sie in die erwartete Entropie eines Testobjekts
+// eingeht
+double weighted_entropy(unsigned long foreground, unsigned long total)
+{
+    return static_cast<double>(total) * binary_entropy(foreground, total);
+}
+
+
+// Untere Schranke für die erwartete Entropie, die ein Testobjekt am Ende
+// höchstens erreichen kann, wenn es bisher total_left Beispiele (davon
+// foreground_left Vordergrund) nach links und total_right (davon
+// foreground_right Vordergrund) nach rechts geschickt hat und noch
+// remaining_foreground Vordergrund- und remaining_background
+// Hintergrundpixel fehlen.
+// weighted_entropy ist konkav in (Vordergrund, Hintergrund), also auch die
+// Summe über links und rechts in Abhängigkeit davon, wieviele der fehlenden
+// Beispiele nach links gehen. Das Minimum liegt daher an einer der vier
+// Ecken, d.h. alle fehlenden Vordergrund- bzw. Hintergrundpixel gehen
+// geschlossen nach links oder nach rechts.
+double expected_entropy_lower_bound(unsigned long foreground_left, unsigned long total_left, unsigned long foreground_right, unsigned long total_right, unsigned long remaining_foreground, unsigned long remaining_background)
+{
+    unsigned long remaining = remaining_foreground + remaining_background;
+    double all_left = weighted_entropy(foreground_left + remaining_foreground, total_left + remaining) +
+        weighted_entropy(foreground_right, total_right);
+    double all_right = weighted_entropy(foreground_left, total_left) +
+        weighted_entropy(foreground_right + remaining_foreground, total_right + remaining);
+    double foreground_to_left = weighted_entropy(foreground_left + remaining_foreground, total_left + remaining_foreground) +
+        weighted_entropy(foreground_right, total_right + remaining_background);
+    double foreground_to_right = weighted_entropy(foreground_left, total_left + remaining_background) +
+        weighted_entropy(foreground_right + remaining_foreground, total_right + remaining_foreground);
+    return std::min(std::min(all_left, all_right), std::min(foreground_to_left, foreground_to_right));
+}
+
+
+
+// notwendige Forward declarations
+template <typename T>
+class Node;
+
+template <typename T>
+class Tree;
+
+template <typename T>
+class NodePool;
+
+
+// während der Entscheidungsbaum aufgebaut wird, wird eine Liste von solchen
+// LearningState-Objekten verwaltet
+// So ein Objekt repräsentiert einen Knoten im Baum, für den bereits ein
+// Testobjekt gelernt wurde, der aber noch keine Kindknoten hat
+template <typename T>
+struct LearningState
+{
+    Node<T>* node;
+
+    // Tiefe des Knotens im Baum
+    unsigned short depth;
+
+    unsigned long from;
+    unsigned long border;
+    unsigned long to;
+
+    // Summe der Gewichte aller Beispiele in [from, to] und davon der
+    // Vordergrundpixel. Die Anzahlen kommen aus der Suche im Elternknoten,
+    // so muss kein Knoten seine Beispiele extra zählen.
+    unsigned long total_count;
+    unsigned long foreground_count;
+
+    // wieviel davon das Testobjekt des Knotens nach links schickt (setzt
+    // Node::build_inner_node)
+    unsigned long total_left;
+    unsigned long foreground_left;
+
+
+    // die Anzahlen für den linken bzw. rechten Kindknoten
+    void set_counts_from_left(const LearningState<T>& parent)
+    {
+        total_count = parent.total_left;
+        foreground_count = parent.foreground_left;
+    }
+
+    void set_counts_from_right(const LearningState<T>& parent)
+    {
+        total_count = parent.total_count - parent.total_left;
+        foreground_count = parent.foreground_count - parent.foreground_left;
+    }
+};
+
+
+
+// Buchführung bei der Suche nach dem besten Testobjekt für einen Knoten
+template <typename T>
+struct SplitSearch
+{
+    double lowest_expected_entropy;
+
+    // das bisher beste Testobjekt, gültig sobald found true ist
+    T best_test;
+    bool found;
+
+    // wieviele Trainingsbeispiele das beste Testobjekt insgesamt nach
+    // rechts bzw. links schickt und wieviele davon Vordergrundpixel sind
+    unsigned long best_total_pixels_left;
+    unsigned long best_total_pixels_right;
+    unsigned long best_foreground_count_left;
+    unsigned long best_foreground_count_right;
+
+    // wird true, wenn dieser Knoten die Trainingsbeispiele perfekt trennt,
+    // d.h. alle Pixel, die tatsächlich zum Vordergrund gehören, werden auf
+    // die eine Seite und alle anderen auf die andere Seite geschickt
+    bool low_entropy_left;
+    bool low_entropy_right;
+
+    // Anzahl der bisher bewerteten Testobjekte, die die Beispiele tatsächlich
+    // trennen
+    unsigned int try_count;
+
+    // in einem Dschungel (siehe Tree::train_jungle) kommen in den
+    // Kindknoten auch Beispiele von anderen Knoten an. Deren Anzahlen werden
+    // bei der Bewertung links bzw. rechts dazugezählt; in einem Baum sind
+    // sie 0.
+    unsigned long base_total_left;
+    unsigned long base_foreground_left;
+    unsigned long base_total_right;
+    unsigned long base_foreground_right;
+
+
+    SplitSearch()
+    {
+        lowest_expected_entropy = std::numeric_limits<double>::infinity();
+        found = false;
+        best_total_pixels_left = 0;
+        best_total_pixels_right = 0;
+        best_foreground_count_left = 0;
+        best_foreground_count_right = 0;
+        low_entropy_left = false;
+        low_entropy_right = false;
+        try_count = 0;
+        base_total_left = 0;
+        base_foreground_left = 0;
+        base_total_right = 0;
+        base_foreground_right = 0;
+    }
+
+
+    // bewertet ein Testobjekt, das von total Beispielen (davon
+    // foreground_total Vordergrundpixel) total_left nach links schickt (davon
+    // foreground_left Vordergrundpixel). Gibt true zurück, wenn das
+    // Testobjekt als bisher bestes übernommen wurde.
+    bool consider(const T& random_test_object, unsigned long total_left, unsigned long foreground_left, unsigned long total, unsigned long foreground_total)
+    {
+        unsigned long total_right = total - total_left;
+        unsigned long foreground_right = foreground_total - foreground_left;
+
+        // Wenn das Trainingsobjekt die Beispiele gar nicht trennt, sondern
+        // alle auf eine Seite sortiert, samplen wir nochmal
+        // TODO: gerät in eine Endlosschleife, wenn die Beispiele gar nicht
+        // trennbar sind, z.B. weil sie identisch sind
+        if(total_left == 0 || total_right == 0) {
+            return false;
+        }
+        ++try_count;
+
+
+        // die Entropie (quasi die Ungleichverteilung) der Verteilung der
+        // beiden Klassen VG und HG an den Ausgängen rechts und links
+        // ausrechnen
+        double entropy_left = binary_entropy(foreground_left + base_foreground_left, total_left + base_total_left);
+        double entropy_right = binary_entropy(foreground_right + base_foreground_right, total_right + base_total_right);
+
+        // daraus die durchschnittliche erwartete Entropie berechnen (ohne zu
+        // normalisieren, weil wir nur das Minimum davon wollen)
+        double expected_entropy = static_cast<double>(total_left + base_total_left) * entropy_left +
+            static_cast<double>(total_right + base_total_right) * entropy_right;
+
+        if(expected_entropy < lowest_expected_entropy) {
+            lowest_expected_entropy = expected_entropy;
+            best_test = random_test_object;
+            found = true;
+            // wenn rechts oder links nur Beispiele aus einer einzigen Klasse
+            // ankommen, ist die Entropie dort 0. In diesem Fall machen wir auf
+            // der Seite einen Blattknoten
+            low_entropy_left = (entropy_left == 0.0);
+            low_entropy_right = (entropy_right == 0.0);
+            best_foreground_count_left = foreground_left;
+            best_foreground_count_right = foreground_right;
+            best_total_pixels_left = total_left;
+            best_total_pixels_right = total_right;
+            return true;
+        }
+        return false;
+    }
+
+
+    // für ein Testobjekt, das die Beispiele nachweislich trennt, aber auch
+    // nachweislich nicht besser als das bisher beste ist
+    void skip()
+    {
+        ++try_count;
+    }
+};
+
+
+
+// beim ebenenweisen Training (siehe Tree::train_levelwise) ein Knoten der
+// aktuellen Ebene, für den noch ein Testobjekt gesucht wird
+template <typename T>
+struct FrontierNode
+{
+    // hier wird der neue Knoten eingehängt
+    Node<T>** slot;
+
+    unsigned short depth;
+
+    // die Trainingsbeispiele des Knotens, wieviele Pixel sie (mit
+    // Gewicht) darstellen und wieviele davon Vordergrundpixel sind
+    unsigned long from;
+    unsigned long to;
+    unsigned long total_count;
+    unsigned long foreground_count;
+};
+
+
+
+// beim Training eines Dschungels (siehe Tree::train_jungle) ein Knoten der
+// aktuellen Ebene mit seinem Testobjekt und den Indizes der beiden Knoten
+// der nächsten Ebene, in die er seine Beispiele schickt
+template <typename T>
+struct JungleNode
+{
+    Node<T>* node;
+    T test;
+
+    // die Beispiele [from, border) gehen nach links, [border, to] nach
+    // rechts
+    unsigned long from;
+    unsigned long border;
+    unsigned long to;
+
+    // wieviele Pixel die Beispiele (mit Gewicht) darstellen und wieviele
+    // davon Vordergrundpixel sind, insgesamt und links
+    unsigned long total_count;
+    unsigned long foreground_count;
+    unsigned long total_left;
+    unsigned long foreground_left;
+
+    unsigned int left_child;
+    unsigned int right_child;
+
+    unsigned long total_right() const
+    {
+        return total_count - total_left;
+    }
+
+    unsigned long foreground_right() const
+    {
+        return foreground_count - foreground_left;
+    }
+};
+
+
+
+// beim Training mit dem besten Knoten zuerst (siehe Tree::train_bestfirst)
+// ein Knoten, der noch nicht in den Baum eingehängt ist. Solange er noch
+// kein Testobjekt hat (searched ist false), ist gain nur eine obere Schranke:
+// weiter als auf 0 kann die gewichtete Entropie nicht sinken.
+template <typename T>
+struct BestFirstCandidate
+{
+    LearningState<T> state;
+
+    // hier wird der Knoten eingehängt
+    Node<T>** slot;
+
+    // ob für den Knoten schon ein Testobjekt gesucht wurde (dann steht es in
+    // state.node)
+    bool searched;
+
+    // um wieviel die Entropie, gewichtet mit der Anzahl der Beispiele, durch
+    // das Testobjekt des Knotens sinkt
+    double gain;
+
+    bool operator<(const BestFirstCandidate<T>& other) const
+    {
+        return gain < other.gain;
+    }
+};
+
+
+
+
+
+template <typename T>
+class Node {
+
+public:
+    // linker und rechter Kindknoten
+    Node* left_child;
+    Node* right_child;
+
+    // ein Knoten kann entweder ein innerer Knoten sein (dann hat er ein
+    // test_object) oder ein Blattknoten (dann ist test_object NULL). Ein
+    // Blattknoten hat immer ein leaf_info, ein innerer Knoten nur, wenn die
+    // Anzahlen der Pixel dort bekannt sind (sonst ist es NULL).
+    // Beide zeigen, wenn sie gesetzt sind, in den Knoten selbst (auf
+    // test_storage bzw. leaf_storage), damit ein Knoten mit allem, was dazu
+    // gehört, am Stück im NodePool des Baums liegt.
+    T* test_object;
+    LeafInfo* leaf_info;
+
+    T test_storage;
+    LeafInfo leaf_storage;
+
+
+    // Knoten werden nur von NodePool angelegt und auch nur mit dem ganzen
+    // Pool wieder freigegeben
+    Node()
+    {
+        left_child = NULL;
+        right_child = NULL;
+        test_object = NULL;
+        leaf_info = NULL;
+    }
+
+
+    void set_test_object(const T& test)
+    {
+        test_storage = test;
+        test_object = &test_storage;
+    }
+
+
+    void set_leaf_info(const LeafInfo& info)
+    {
+        leaf_storage = info;
+        leaf_info = &leaf_storage;
+    }
+
+
+    // baut und gibt einen neuen Knoten zurück, der die Pixel am besten trennt
+    // Das funktioniert, indem eine Anzahl von Testobjekten zufällig erzeugt
+    // wird. Mit jedem davon trennt man die Trainingspixel, die an diesem
+    // Knoten ankommen und misst in den entstandenen Teilmengen das Verhältnis
+    // von Vordergrund- zu Hintergrundpixeln. Je ungleicher das Verhältnis,
+    // desto besser. Das beste Trainingsobjekt wird für diesen Knoten genommen.
+    // Die Anzahlen der Beispiele stehen schon in state, die Anzahlen links
+    // werden dort für die Kindknoten eingetragen.
+    static Node<T>* build_inner_node(LearningState<T>& state, SampleStore& samples, NodePool<T>& pool)
+    {
+        const unsigned long node_total = state.total_count;
+        const unsigned long node_foreground = state.foreground_count;
+
+        SplitSearch<T> search;
+
+        // in großen Knoten erst mit Stichproben die aussichtsreichsten
+        // Testobjekte heraussuchen und nur die auf allen Beispielen bewerten
+        if(samples.settings->subsampled_split_scoring && state.to - state.from + 1 >= 8 * SUBSAMPLE_START_SIZE) {
+            std::vector<T> finalists = preselect_candidates(state, samples);
+            for(size_t f = 0; f < finalists.size(); f += T::Block::MAX_SIZE) {
+                typename T::Block block;
+                block.size = std::min(static_cast<unsigned int>(finalists.size() - f), T::Block::MAX_SIZE);
+                std::copy(finalists.begin() + f, finalists.begin() + f + block.size, block.tests);
+                evaluate_block(block, state, samples, node_total, node_foreground, search);
+            }
+            // falls keiner der Finalisten die Beispiele trennt, wird ganz
+            // normal weitergesucht
+            if(search.found) {
+                state.total_left = search.best_total_pixels_left;
+                state.foreground_left = search.best_foreground_count_left;
+                return build_split_node(search, state.depth, *samples.parameters, pool);
+            }
+        }
+
+        // Die Testobjekte werden blockweise ausgewürfelt und ausgewertet:
+        // jedes Trainingsbeispiel wird pro Block nur einmal gelesen und gleich
+        // mit allen Testobjekten des Blocks getestet, statt für jedes
+        // Testobjekt einen eigenen Durchlauf über die im Speicher verstreuten
+        // Trainingsbeispiele zu machen.
+        typename T::Block block;
+        while(search.try_count < samples.parameters->testobject_tries) {
+            sample_block(block, search.try_count, *samples.parameters, *samples.random);
+            evaluate_block(block, state, samples, node_total, node_foreground, search);
+        }
+
+        state.total_left = search.best_total_pixels_left;
+        state.foreground_left = search.best_foreground_count_left;
+        return build_split_node(search, state.depth, *samples.parameters, pool);
+    }
+
+
+    // wertet alle Testobjekte aus block auf allen Trainingsbeispielen des
+    // Knotens (node_total, davon node_foreground Vordergrundpixel) aus und übergibt sie
+    // an search.
+    // Alle ENTROPY_BOUND_INTERVAL Beispiele wird geprüft, ob ein Testobjekt
+    // mit den restlichen Beispielen überhaupt noch besser als das bisher
+    // beste werden kann (siehe expected_entropy_lower_bound). Wenn nicht,
+    // wird es nicht weiter ausgewertet. Das ändert nichts am Ergebnis, weil
+    // nur Testobjekte aussortiert werden, die die Beispiele schon trennen
+    // (also auch sonst als Versuch gezählt würden) und sowieso nicht
+    // gewonnen hätten.
+    static void evaluate_block(typename T::Block& block, LearningState<T>& state, SampleStore& samples, unsigned long node_total, unsigned long node_foreground, SplitSearch<T>& search)
+    {
+        unsigned int block_size = block.size;
+        T tests[T::Block::MAX_SIZE];
+        std::copy(block.tests, block.tests + block_size, tests);
+
+        // Zähler der noch aktiven Testobjekte, in derselben Reihenfolge wie
+        // im Block, und für jedes davon die ursprüngliche Position
+        unsigned long block_total_left[T::Block::MAX_SIZE];
+        unsigned long block_foreground_left[T::Block::MAX_SIZE];
+        unsigned int positions[T::Block::MAX_SIZE];
+        bool aborted[T::Block::MAX_SIZE];
+
+        block.prepare(samples.strides, samples.augmentations);
+        for(unsigned int j = 0; j < block_size; ++j) {
+            block_total_left[j] = 0;
+            block_foreground_left[j] = 0;
+            positions[j] = j;
+            aborted[j] = false;
+        }
+
+        // die Ergebnisse jedes Beispiels werden gespeichert, damit die
+        // Beispiele nachher ohne neue Auswertung des Gewinners aufgeteilt
+        // werden können. Die Bits beziehen sich auf die Reihenfolge im Block
+        // beim jeweiligen Stück, deshalb wird für jedes Stück gemerkt, welche
+        // Testobjekte (nach ursprünglicher Position) davor abgebrochen wurden.
+        samples.allocate_outcome_buffers();
+        unsigned int* outcomes = samples.block_outcomes.begin();
+        std::vector<unsigned int> aborted_before_chunk;
+        unsigned int aborted_mask = 0;
+
+        // Anzahl der bisher gezählten Trainingsbeispiele in diesem Knoten und
+        // wieviele davon Vordergrundpixel sind
+        unsigned long total = 0;
+        unsigned long foreground_total = 0;
+
+        // über alle Trainingsbeispiele iterieren, mit denen dieser Knoten
+        // trainiert werden soll
+        for(unsigned long chunk = state.from; chunk <= state.to; chunk += ENTROPY_BOUND_INTERVAL) {
+            unsigned long chunk_end = std::min(chunk + ENTROPY_BOUND_INTERVAL - 1, static_cast<unsigned long>(state.to));
+            aborted_before_chunk.push_back(aborted_mask);
+            for(unsigned long i = chunk; i <= chunk_end; ++i) {
+                unsigned long weight = samples.weight(i);
+                unsigned long foreground_weight = samples.is_foreground(i) * weight;
+                outcomes[i] = block.count_left(samples.source(i), samples.center(i), weight, foreground_weight, block_total_left, block_foreground_left);
+                foreground_total += foreground_weight;
+                total += weight;
+            }
+
+            if(chunk_end == state.to || !search.found || block.size == 0) {
+                continue;
+            }
+
+            unsigned long remaining_foreground = node_foreground - foreground_total;
+            unsigned long remaining_background = (node_total - total) - remaining_foreground;
+            // kleiner Sicherheitsabstand wegen Rundungsfehlern
+            double threshold = search.lowest_expected_entropy * (1.0 + 1e-9) + 1e-9;
+
+            bool keep[T::Block::MAX_SIZE];
+            bool any_aborted = false;
+            for(unsigned int j = 0; j < block.size; ++j) {
+                unsigned long total_left = block_total_left[j];
+                unsigned long foreground_left = block_foreground_left[j];
+                keep[j] = true;
+                if(total_left > 0 && total_left < total &&
+                        expected_entropy_lower_bound(foreground_left, total_left, foreground_total - foreground_left, total - total_left, remaining_foreground, remaining_background) > threshold) {
+                    keep[j] = false;
+                    aborted[positions[j]] = true;
+                    aborted_mask |= 1u << positions[j];
+                    any_aborted = true;
+                }
+            }
+
+            if(any_aborted) {
+                unsigned int kept = 0;
+                for(unsigned int j = 0; j < block.size; ++j) {
+                    if(keep[j]) {
+                        block_total_left[kept] = block_total_left[j];
+                        block_foreground_left[kept] = block_foreground_left[j];
+                        positions[kept] = positions[j];
+                        ++kept;
+                    }
+                }
+                block.compact(keep);
+            }
+        }
+
+        // Ergebnisse in der ursprünglichen Reihenfolge an search übergeben
+        unsigned long final_total_left[T::Block::MAX_SIZE];
+        unsigned long final_foreground_left[T::Block::MAX_SIZE];
+        for(unsigned int j = 0; j < block.size; ++j) {
+            final_total_left[positions[j]] = block_total_left[j];
+            final_foreground_left[positions[j]] = block_foreground_left[j];
+        }
+        int winner = -1;
+        for(unsigned int j = 0; j < block_size; ++j) {
+            if(aborted[j]) {
+                search.skip();
+            } else if(search.consider(tests[j], final_total_left[j], final_foreground_left[j], total, foreground_total)) {
+                winner = j;
+            }
+        }
+
+        // wenn der neue Gewinner aus diesem Block kommt, seine Ergebnisse
+        // herausziehen
+        if(winner >= 0) {
+            unsigned int p = winner;
+            unsigned long chunk_index = 0;
+            for(unsigned long chunk = state.from; chunk <= state.to; chunk += ENTROPY_BOUND_INTERVAL, ++chunk_index) {
+                unsigned long chunk_end = std::min(chunk + ENTROPY_BOUND_INTERVAL - 1, static_cast<unsigned long>(state.to));
+                // Position im Block während dieses Stücks: die ursprüngliche
+                // Position minus die vorher abgebrochenen Testobjekte davor
+                unsigned int bit = p;
+                for(unsigned int q = 0; q < p; ++q) {
+                    bit -= (aborted_before_chunk[chunk_index] >> q) & 1;
+                }
+                for(unsigned long i = chunk; i <= chunk_end; ++i) {
+                    samples.goes_left[i] = static_cast<unsigned char>((outcomes[i] >> bit) & 1);
+                }
+            }
+        }
+    }
+
+
+    // Vorauswahl der Testobjekte für große Knoten: Alle Testobjekte werden
+    // auf einer zufälligen Stichprobe der Trainingsbeispiele bewertet, die
+    // sich in jeder Runde verdoppelt. Die normalisierte erwartete Entropie
+    // eines Testobjekts ist H = q h(a) + (1 - q) h(b), mit dem Anteil q der
+    // Beispiele, die nach links gehen, und den Anteilen a und b der
+    // Vordergrundpixel links und rechts. Für q, a und b gibt es aus den
+    // Zählern der Stichprobe Konfidenzintervalle (siehe
+    // probability_interval; die Ziehungen, die links bzw. rechts landen,
+    // sind für sich wieder unabhängig gezogen). Weil h konkav und H in q
+    // linear ist, ergeben sich daraus eine untere und eine obere Schranke
+    // für H. Testobjekte, deren untere Schranke über der kleinsten oberen
+    // Schranke liegt, fliegen raus. Alle Intervalle aller Testobjekte in
+    // allen Runden gelten zusammen mit Wahrscheinlichkeit
+    // 1 - SUBSAMPLE_DELTA, mit dieser Wahrscheinlichkeit ist also das beste
+    // Testobjekt unter den übrigen.
+    // Sobald höchstens SUBSAMPLE_FINALISTS übrig sind oder die Stichprobe
+    // ein Sechzehntel des Knotens erreicht, werden alle übrigen zurückgegeben
+    // und auf allen Beispielen bewertet; es wird also nicht geraten, welches
+    // davon das beste ist. Die Stichproben zusammen sind so höchstens ein
+    // Achtel des Knotens groß.
+    // Zusammengefasste Beispiele (siehe SampleStore::deduplicate) werden
+    // proportional zu ihrem Gewicht gezogen und jede Ziehung zählt einfach.
+    // So ist die Stichprobe eine aus den ursprünglichen Trainingspixeln, und
+    // die Ziehungen sind unabhängig.
+    static std::vector<T> preselect_candidates(LearningState<T>& state, SampleStore& samples)
+    {
+        unsigned long node_size = state.to - state.from + 1;
+
+        // ohne Zusammenfassen haben alle Beispiele das Gewicht 1, sonst wird
+        // in den aufsummierten Gewichten gesucht
+        const bool weighted = samples.settings->deduplicate_samples;
+        unsigned long* cumulative = NULL;
+        unsigned long node_weight = node_size;
+        if(weighted) {
+            if(samples.cumulative_weights.size() < samples.size()) {
+                samples.allocate_buffer(samples.cumulative_weights, samples.size(), ".gewichte");
+            }
+            cumulative = samples.cumulative_weights.begin() + state.from;
+            node_weight = 0;
+            for(unsigned long i = 0; i < node_size; ++i) {
+                node_weight += samples.weight(state.from + i);
+                cumulative[i] = node_weight;
+            }
+        }
+
+        std::vector<T> candidates(samples.parameters->testobject_tries);
+        for(unsigned int c = 0; c < candidates.size(); ++c) {
+            candidates[c] = T::sample(*samples.parameters, *samples.random);
+        }
+
+        // SUBSAMPLE_DELTA wird auf die drei Intervalle jedes Testobjekts in
+        // jeder Runde aufgeteilt
+        unsigned int rounds = 1;
+        for(unsigned long size = SUBSAMPLE_START_SIZE; 16 * size <= node_weight; size *= 2) {
+            ++rounds;
+        }
+        const double log_term = log(2.0 * 3.0 * candidates.size() * rounds / SUBSAMPLE_DELTA);
+
+        // die Zähler beziehen sich immer auf alle bisher gezogenen Beispiele
+        std::vector<unsigned long> total_left(candidates.size(), 0);
+        std::vector<unsigned long> foreground_left(candidates.size(), 0);
+        unsigned long total = 0;
+        unsigned long foreground_total = 0;
+
+        std::vector<unsigned long> subsample;
+        unsigned long subsample_size = SUBSAMPLE_START_SIZE;
+
+        while(true) {
+            // die Stichprobe auf subsample_size Beispiele auffüllen (mit
+            // Zurücklegen gezogen)
+            unsigned long drawn_before = subsample.size();
+            while(subsample.size() < subsample_size) {
+                if(weighted) {
+                    unsigned long r = samples.random->index(node_weight);
+                    subsample.push_back(state.from + (std::upper_bound(cumulative, cumulative + node_size, r) - cumulative));
+                } else {
+                    subsample.push_back(state.from + samples.random->index(node_size));
+                }
+            }
+            for(unsigned long n = drawn_before; n < subsample.size(); ++n) {
+                foreground_total += samples.is_foreground(subsample[n]);
+                total += 1;
+            }
+
+            // die noch übrigen Testobjekte auf den neuen Beispielen auswerten
+            for(size_t c = 0; c < candidates.size(); c += T::Block::MAX_SIZE) {
+                typename T::Block block;
+                block.size = std::min(static_cast<unsigned int>(candidates.size() - c), T::Block::MAX_SIZE);
+                std::copy(candidates.begin() + c, candidates.begin() + c + block.size, block.tests);
+                block.prepare(samples.strides, samples.augmentations);
+                for(unsigned long n = drawn_before; n < subsample.size(); ++n) {
+                    unsigned long i = subsample[n];
+                    block.count_left(samples.source(i), samples.center(i), 1, samples.is_foreground(i), &total_left[c], &foreground_left[c]);
+                }
+            }
+
+            // solange schon der feste Teil des Intervalls für q mindestens
+            // 1/2 ist, enthalten alle Intervalle für a und b die 1/2, jede
+            // obere Schranke ist also 1 Bit und es fliegt nichts raus
+            if(7.0 * log_term / (3.0 * (total - 1.0)) >= 0.5) {
+                if(16 * subsample_size > node_weight) {
+                    break;
+                }
+                subsample_size *= 2;
+                continue;
+            }
+
+            // untere und obere Schranke für die normalisierte erwartete
+            // Entropie jedes Testobjekts
+            std::vector<double> lower_bounds(candidates.size());
+            double best_upper_bound = std::numeric_limits<double>::infinity();
+            for(size_t c = 0; c < candidates.size(); ++c) {
+                double left_low, left_high, left_fg_low, left_fg_high, right_fg_low, right_fg_high;
+                probability_interval(total_left[c], total, log_term, left_low, left_high);
+                probability_interval(foreground_left[c], total_left[c], log_term, left_fg_low, left_fg_high);
+                probability_interval(foreground_total - foreground_left[c], total - total_left[c], log_term, right_fg_low, right_fg_high);
+
+                double left_min, left_max, right_min, right_max;
+                entropy_range(left_fg_low, left_fg_high, left_min, left_max);
+                entropy_range(right_fg_low, right_fg_high, right_min, right_max);
+
+                lower_bounds[c] = std::min(left_low * left_min + (1.0 - left_low) * right_min,
+                        left_high * left_min + (1.0 - left_high) * right_min);
+                double upper_bound = std::max(left_low * left_max + (1.0 - left_low) * right_max,
+                        left_high * left_max + (1.0 - left_high) * right_max);
+                best_upper_bound = std::min(best_upper_bound, upper_bound);
+            }
+
+            // alle Testobjekte aussortieren, die das beste mit hoher
+            // Wahrscheinlichkeit nicht mehr schlagen können
+            size_t kept = 0;
+            for(size_t c = 0; c < candidates.size(); ++c) {
+                if(lower_bounds[c] <= best_upper_bound) {
+                    candidates[kept] = candidates[c];
+                    total_left[kept] = total_left[c];
+                    foreground_left[kept] = foreground_left[c];
+                    ++kept;
+                }
+            }
+            candidates.resize(kept);
+            total_left.resize(kept);
+            foreground_left.resize(kept);
+
+            if(candidates.size() <= SUBSAMPLE_FINALISTS || 16 * subsample_size > node_weight) {
+                break;
+            }
+            subsample_size *= 2;
+        }
+
+        return candidates;
+    }
+
+
+    // kleinste und größte binäre Entropie einer Wahrscheinlichkeit in
+    // [low, high]. Die Entropie ist konkav, das Minimum liegt also an einem
+    // der Ränder und das Maximum bei 1/2 oder dem Rand, der am nächsten
+    // daran liegt.
+    static void entropy_range(double low, double high, double& min_entropy, double& max_entropy)
+    {
+        min_entropy = std::min(binary_entropy(low), binary_entropy(high));
+        max_entropy = binary_entropy(std::min(std::max(0.5, low), high));
+    }
+
+
+    // würfelt für den nächsten Block Testobjekte aus. Es werden nie mehr
+    // Testobjekte ausgewürfelt als noch gebraucht werden, dann kommen genau
+    // dieselben Testobjekte dran wie bei einzelner Auswertung.
+    static void sample_block(typename T::Block& block, unsigned int try_count, const ForestParameters& parameters, Random& random)
+    {
+        block.size = std::min(parameters.testobject_tries - try_count, T::Block::MAX_SIZE);
+        for(unsigned int j = 0; j < block.size; ++j) {
+            block.tests[j] = T::sample(parameters, random);
+        }
+    }
+
+
+    // baut den inneren Knoten mit dem besten Testobjekt aus der Suche
+    static Node<T>* build_split_node(SplitSearch<T>& search, unsigned short depth, const ForestParameters& parameters, NodePool<T>& pool)
+    {
+        Node<T>* new_node = pool.allocate();
+        new_node->set_test_object(search.best_test);
+
+        // die Anzahlen in diesem Knoten, falls er später zu einem Blatt wird
+        new_node->set_leaf_info(LeafInfo());
+        new_node->leaf_info->foreground_count = search.best_foreground_count_left + search.best_foreground_count_right;
+        new_node->leaf_info->total_count = search.best_total_pixels_left + search.best_total_pixels_right;
+        new_node->leaf_info->foreground_probability = 0.0;
+        new_node->leaf_info->update_probability();
+
+
+        // an new_node links einen Blattknoten anhängen, wenn die maximale
+        // Tiefe erreicht ist oder die Entropie dort 0 ist
+        if(search.low_entropy_left || depth >= parameters.max_tree_depth) {
+            new_node->left_child = build_leaf_node(search.best_foreground_count_left, search.best_total_pixels_left, pool);
+        }
+
+        // ebenso rechts
+        if(search.low_entropy_right || depth >= parameters.max_tree_depth) {
+            new_node->right_child = build_leaf_node(search.best_foreground_count_right, search.best_total_pixels_right, pool);
+        }
+
+        return new_node;
+    }
+
+
+    static Node<T>* build_leaf_node(unsigned long foreground_count, unsigned long total, NodePool<T>& pool)
+    {
+        Node<T>* new_leaf = pool.allocate();
+        new_leaf->set_leaf_info(LeafInfo());
+
+        // foreground_probability ist einfach die Anzahl der ankommenden
+        // Vordergrundpixel geteilt durch die Gesamtzahl der ankommenden Pixel
+        new_leaf->leaf_info->foreground_count = foreground_count;
+        new_leaf->leaf_info->total_count = total;
+        new_leaf->leaf_info->foreground_probability = 0.0;
+        new_leaf->leaf_info->update_probability();
+
+        return new_leaf;
+    }
+
+
+    static Node<T>* from_json(JSONValue* json_value, const ForestParameters& parameters, NodePool<T>& pool)
+    {
+        Node<T>* new_node = pool.allocate();
+        // Blätter mit Anzahlen sind Arrays mit 2 Einträgen, innere Knoten
+        // haben 3 oder (mit Anzahlen) 4 Einträge
+        if(json_value->IsArray() && json_value->AsArray().size() >= 3) { // ein innerer Knoten
+            const JSONArray& array = json_value->AsArray();
+            new_node->set_test_object(T::from_json(array[0], parameters));
+            new_node->left_child = Node<T>::from_json(array[1], parameters, pool);
+            new_node->right_child = Node<T>::from_json(array[2], parameters, pool);
+            if(array.size() >= 4) {
+                new_node->set_leaf_info(LeafInfo::from_json(array[3]));
+            }
+        } else { // Blattknoten
+            new_node->set_leaf_info(LeafInfo::from_json(json_value));
+        }
+        return new_node;
+    }
+
+
+    JSONValue* to_json()
+    {
+        if(test_object != NULL) {
+            JSONArray node_array;
+            node_array.push_back(test_object->to_json());
+            node_array.push_back(left_child->to_json());
+            node_array.push_back(right_child->to_json());
+            if(leaf_info != NULL && leaf_info->total_count > 0) {
+                node_array.push_back(leaf_info->to_json());
+            }
+            return new JSONValue(node_array);
+        } else {
+            return leaf_info->to_json();
+        }
+    }
+
+
+    // setzt die Anzahlen in allen Knoten ab diesem auf 0
+    void reset_counts()
+    {
+        if(leaf_info != NULL) {
+            leaf_info->foreground_count = 0;
+            leaf_info->total_count = 0;
+        }
+        if(test_object != NULL) {
+            left_child->reset_counts();
+            right_child->reset_counts();
+        }
+    }
+
+
+    // true, wenn alle Testobjekte ab diesem Knoten ihre Offsets aus dem
+    // Offset-Pool haben
+    bool in_offset_pool()
+    {
+        if(test_object == NULL) {
+            return true;
+        }
+        return test_object->pool_index >= 0 && left_child->in_offset_pool() && right_child->in_offset_pool();
+    }
+
+
+    void update_probabilities()
+    {
+        if(leaf_info != NULL) {
+            leaf_info->update_probability();
+        }
+        if(test_object != NULL) {
+            left_child->update_probabilities();
+            right_child->update_probabilities();
+        }
+    }
+
+
+    // ob truncate gehen würde: alle inneren Knoten, die tiefer als max_depth
+    // liegen, müssen Anzahlen haben, um zum Blatt zu werden. Dieser Knoten
+    // liegt in der Tiefe depth (die Wurzel in Tiefe 1).
+    bool can_truncate(unsigned short depth, unsigned short max_depth) const
+    {
+        if(test_object == NULL) {
+            return true;
+        }
+        if(depth <= max_depth) {
+            return left_child->can_truncate(depth + 1, max_depth) && right_child->can_truncate(depth + 1, max_depth);
+        }
+        return leaf_info != NULL && leaf_info->total_count > 0;
+    }
+
+
+    // macht alle inneren Knoten, die tiefer als max_depth liegen, zu
+    // Blättern. Vorher muss can_truncate geprüft sein, damit nicht nur ein
+    // Teil abgeschnitten wird. Die abgeschnittenen Knoten bleiben bis zum
+    // Löschen des Baums im NodePool liegen.
+    void truncate(unsigned short depth, unsigned short max_depth)
+    {
+        if(test_object == NULL) {
+            return;
+        }
+        if(depth <= max_depth) {
+            left_child->truncate(depth + 1, max_depth);
+            right_child->truncate(depth + 1, max_depth);
+            return;
+        }
+        test_object = NULL;
+        left_child = NULL;
+        right_child = NULL;
+    }
+
+};
+
+
+
+// der Speicher für alle Knoten eines Baums (samt Testobjekten und
+// LeafInfo-Objekten, siehe Node). Statt jeden Knoten einzeln mit new
+// anzulegen, werden sie der Reihe nach aus großen Blöcken vergeben und erst
+// mit dem ganzen Pool wieder freigegeben. Die Blöcke werden immer größer, so
+// brauchen kleine Bäume wenig Speicher und große nur selten einen neuen
+// Block.
+template <typename T>
+class NodePool
+{
+
+public:
+    NodePool()
+    {
+        next_free = 0;
+    }
+
+
+    ~NodePool()
+    {
+        for(size_t b = 0; b < blocks.size(); ++b) {
+            delete[] blocks[b];
+        }
+    }
+
+
+    Node<T>* allocate()
+    {
+        if(blocks.empty() || next_free == block_sizes.back()) {
+            size_t size = (blocks.empty() ? static_cast<size_t>(FIRST_BLOCK_SIZE) : std::min(2 * block_sizes.back(), static_cast<size_t>(MAX_BLOCK_SIZE)));
+            blocks.push_back(new Node<T>[size]);
+            block_sizes.push_back(size);
+            next_free = 0;
+        }
+        return &blocks.back()[next_free++];
+    }
+
+
+private:
+    enum { FIRST_BLOCK_SIZE = 64, MAX_BLOCK_SIZE = 65536 };
+
+    std::vector<Node<T>*> blocks;
+    std::vector<size_t> block_sizes;
+
+    // der nächste freie Knoten im letzten Block
+    size_t next_free;
+
+    // die Knoten zeigen auf ihre Nachbarn im Pool, deshalb darf er nicht
+    // kopiert werden
+    NodePool(const NodePool&);
+    NodePool& operator=(const NodePool&);
+};
+
+
+
+// sortiert die Beispiele im Intervall [from, to] so um, dass die Beispiele,
+// die das Testobjekt des Knotens nach links klassifiziert, alle vor den
+// anderen kommen. Gibt den Index mit der Grenze zurück, nämlich dem ersten
+// von den rechten Beispielen. Die Ergebnisse des Testobjekts stehen schon in
+// samples.goes_left (siehe Node::evaluate_block und Tree::train_levelwise),
+// es muss also nicht noch einmal ausgewertet werden. Die Beispiele werden
+// stabil aufgeteilt, auf beiden Seiten bleibt ihre Reihenfolge erhalten.
+unsigned long partition_samples(SampleStore& samples, unsigned long from, unsigned long to)
+{
+    const unsigned char* goes_left = samples.goes_left.begin();
+    samples.allocate_partition_buffers();
+    SampleStore::Key* keys = samples.keys.begin();
+    SampleStore::Key* spare_keys = samples.partition_buffer.begin() + from;
+
+    if(!samples.with_windows) {
+        // ohne Verzweigungen: jedes Beispiel wird sowohl an die nächste
+        // linke als auch an die nächste rechte Stelle geschrieben, und nur
+        // der passende Zähler wird erhöht. Die linken Beispiele können an
+        // Ort und Stelle nach vorne rücken, weil die Schreibposition nie
+        // vor der Leseposition liegt.
+        unsigned long left_count = 0;
+        unsigned long right_count = 0;
+        for(unsigned long i = from; i <= to; ++i) {
+            SampleStore::Key key = keys[i];
+            unsigned long is_left = goes_left[i];
+            keys[from + left_count] = key;
+            spare_keys[right_count] = key;
+            left_count += is_left;
+            right_count += 1 - is_left;
+        }
+        std::copy(spare_keys, spare_keys + right_count, keys + from + left_count);
+
+        return from + left_count;
+    }
+
+    // die Fenster sind zu groß, um jedes zweimal zu schreiben. Die Beispiele
+    // der größeren Seite rücken an Ort und Stelle zu ihrem Ende des
+    // Intervalls, die der kleineren kommen mit ihren Fenstern in den
+    // Zwischenspeicher und danach dahinter bzw. davor. Das Intervall ab from
+    // bekommt dort den Platz ab from / 2, so kommen sich Knoten, die
+    // parallel aufgeteilt werden, nicht in die Quere.
+    const unsigned long window_bytes = samples.window_bytes;
+    unsigned char* windows = samples.windows;
+    unsigned char* spare_windows = samples.partition_windows.begin() + (from / 2) * window_bytes;
+
+    unsigned long left_count = 0;
+    for(unsigned long i = from; i <= to; ++i) {
+        left_count += goes_left[i];
+    }
+    unsigned long right_count = to - from + 1 - left_count;
+
+    if(left_count >= right_count) {
+        unsigned long left = from;
+        unsigned long right = 0;
+        for(unsigned long i = from; i <= to; ++i) {
+            unsigned char* window = windows + i * window_bytes;
+            if(goes_left[i]) {
+                if(left != i) {
+                    keys[left] = keys[i];
+                    std::copy(window, window + window_bytes, windows + left * window_bytes);
+                }
+                ++left;
+            } else {
+                spare_keys[right] = keys[i];
+                std::copy(window, window + window_bytes, spare_windows + right * window_bytes);
+                ++right;
+            }
+        }
+        std::copy(spare_keys, spare_keys + right_count, keys + left);
+        std::copy(spare_windows, spare_windows + right_count * window_bytes, windows + left * window_bytes);
+    } else {
+        unsigned long left = left_count;
+        unsigned long right = to + 1;
+        for(unsigned long i = to + 1; i-- > from; ) {
+            unsigned char* window = windows + i * window_bytes;
+            if(!goes_left[i]) {
+                --right;
+                if(right != i) {
+                    keys[right] = keys[i];
+                    std::copy(window, window + window_bytes, windows + right * window_bytes);
+                }
+            } else {
+                --left;
+                spare_keys[left] = keys[i];
+                std::copy(window, window + window_bytes, spare_windows + left * window_bytes);
+            }
+        }
+        std::copy(spare_keys, spare_keys + left_count, keys + from);
+        std::copy(spare_windows, spare_windows + left_count * window_bytes, windows + from * window_bytes);
+    }
+
+    return from + left_count;
+}
+
+
+// bringt die Beispiele ab from in eine neue Reihenfolge: das Beispiel
+// from + i kommt an die Stelle from + destinations[i]. Die Permutation wird
+// Zyklus für Zyklus mit Vertauschungen ausgeführt, so braucht es keinen
+// zweiten Puffer für die Fenster. destinations ist danach die Identität.
+void reorder_samples(SampleStore& samples, unsigned long from, std::vector<unsigned long>& destinations)
+{
+    for(unsigned long i = 0; i < destinations.size(); ++i) {
+        while(destinations[i] != i) {
+            unsigned long j = destinations[i];
+            samples.swap(from + i, from + j);
+            std::swap(destinations[i], destinations[j]);
+        }
+    }
+}
+
+
+
+template <typename T>
+class Tree
+{
+
+public:
+
+    Node<T>* root;
+
+    // hier liegen alle Knoten des Baums
+    NodePool<T> nodes;
+
+    // bei einem Dschungel (siehe train_jungle) alle Knoten Ebene für Ebene,
+    // die Wurzel zuerst. Weil die Knoten dort mehrere Eltern haben können,
+    // würden die rekursiven Funktionen von Node manche Knoten sehr oft
+    // besuchen, deshalb wird stattdessen diese Liste durchlaufen. Bei einem
+    // normalen Baum ist sie leer.
+    std::vector<Node<T>*> jungle_nodes;
+
+
+    Tree()
+    {
+        root = NULL;
+    }
+
+
+    static Tree* train(TrainingData& labels)
+    {
+        Tree<T>* tree = new Tree;
+
+
+        // alle Pixel in den Trainingsbildern, die für das Training benutzt
+        // werden
+        SampleStore samples(labels);
+        unsigned long samples_count = samples.size() - 1;
+
+
+        // Wurzelknoten bauen, und zwar mit allen Samples aus der Liste
+        // (nur hier werden die Beispiele gezählt, alle anderen Knoten
+        // bekommen ihre Anzahlen vom Elternknoten)
+        LearningState<T> root_state;
+        root_state.depth = 1;
+        root_state.from = 0;
+        root_state.to = samples_count;
+        samples.count(root_state.from, root_state.to, root_state.total_count, root_state.foreground_count);
+        tree->root = Node<T>::build_inner_node(root_state, samples, tree->nodes);
+
+        // die Liste so umsortieren, dass alle Pixel, die der Wurzelknoten nach
+        // links schickt auch links in der Liste sitzen
+        root_state.border = partition_samples(samples, root_state.from, root_state.to);
+        root_state.node = tree->root;
+
+
+        // hier sind die Knoten drin, die schon ein Testobjekt haben, aber noch
+        // keine Kindknoten
+        std::deque<LearningState<T> > pending_nodes;
+        pending_nodes.push_back(root_state);
+
+        while(!pending_nodes.empty()) {
+            LearningState<T> current_pending_node = pending_nodes.back();
+            pending_nodes.pop_back();
+
+            // ist die Zeit um, werden die Kindknoten gleich Blätter
+            bool out_of_time = past_deadline(*samples.settings);
+
+            // prüfen, ob links nicht schon ein Blattknoten ist (z.B. weil die
+            // maximale Tiefe erreicht wurde)
+            if(current_pending_node.node->left_child == NULL) {
+                LearningState<T> left_state = current_pending_node; // kopieren
+                left_state.depth += 1;
+                // der zukünftige linke Kindknoten soll nur die Trainingspixel
+                // verwenden, die current_pending_node.node nach links schickt
+                left_state.to = left_state.border - 1;
+                left_state.set_counts_from_left(current_pending_node);
+                if(out_of_time) {
+                    left_state.node->left_child = Node<T>::build_leaf_node(left_state.foreground_count, left_state.total_count, tree->nodes);
+                } else {
+                    Node<T>* new_node = Node<T>::build_inner_node(left_state, samples, tree->nodes);
+                    left_state.border = partition_samples(samples, left_state.from, left_state.to);
+                    left_state.node->left_child = new_node;
+                    left_state.node = new_node;
+                    pending_nodes.push_back(left_state);
+                }
+            }
+
+            if(current_pending_node.node->right_child == NULL) {
+                LearningState<T> right_state = current_pending_node;
+                right_state.depth += 1;
+                right_state.from = right_state.border;
+                right_state.set_counts_from_right(current_pending_node);
+                if(out_of_time) {
+                    right_state.node->right_child = Node<T>::build_leaf_node(right_state.foreground_count, right_state.total_count, tree->nodes);
+                } else {
+                    Node<T>* new_node = Node<T>::build_inner_node(right_state, samples, tree->nodes);
+                    right_state.border = partition_samples(samples, right_state.from, right_state.to);
+                    right_state.node->right_child = new_node;
+                    right_state.node = new_node;
+                    pending_nodes.push_back(right_state);
+                }
+            }
+        }
+
+        return tree;
+    }
+
+
+    // Variante von train(), bei der als nächstes immer der Knoten geteilt
+    // wird, der die Entropie (gewichtet mit der Anzahl seiner Beispiele) am
+    // stärksten verringert. Hat der Baum max_tree_leaves Blätter (siehe
+    // TrainingSettings), werden alle übrigen Knoten zu Blättern. So lassen
+    // sich die Größe des Baums und die Länge der Wege bei der Inferenz direkt
+    // begrenzen.
+    //
+    // Ein Knoten sucht sein Testobjekt erst, wenn er mit seiner oberen
+    // Schranke vorne in der Warteschlange steht und noch Blätter frei sind.
+    // Weil kein anderer Knoten mehr bringen kann, ändert das nichts an der
+    // Reihenfolge, aber Knoten, die am Ende sowieso Blätter werden, suchen
+    // gar nicht erst.
+    static Tree* train_bestfirst(TrainingData& labels)
+    {
+        Tree<T>* tree = new Tree;
+
+        SampleStore samples(labels);
+
+        std::priority_queue<BestFirstCandidate<T> > candidates;
+        const unsigned int max_tree_leaves = samples.settings->max_tree_leaves;
+
+        LearningState<T> root_state;
+        root_state.depth = 1;
+        root_state.from = 0;
+        root_state.to = samples.size() - 1;
+        samples.count(root_state.from, root_state.to, root_state.total_count, root_state.foreground_count);
+        candidates.push(unsearched_bestfirst_candidate(root_state, &tree->root));
+
+        unsigned long number_of_leaves = 1;
+
+        while(!candidates.empty()) {
+            BestFirstCandidate<T> best = candidates.top();
+            candidates.pop();
+
+            if((max_tree_leaves != 0 && number_of_leaves >= max_tree_leaves) || past_deadline(*samples.settings)) {
+                // kein Platz oder keine Zeit mehr, der Knoten wird ein Blatt
+                *(best.slot) = Node<T>::build_leaf_node(best.state.foreground_count, best.state.total_count, tree->nodes);
+                continue;
+            }
+
+            if(!best.searched) {
+                candidates.push(search_bestfirst_candidate(best, samples, tree->nodes));
+                continue;
+            }
+
+            // aus einem Blatt werden zwei
+            Node<T>* node = best.state.node;
+            *(best.slot) = node;
+            number_of_leaves += 1;
+
+            if(node->left_child == NULL) {
+                LearningState<T> left_state = best.state;
+                left_state.depth += 1;
+                left_state.to = left_state.border - 1;
+                left_state.set_counts_from_left(best.state);
+                candidates.push(unsearched_bestfirst_candidate(left_state, &node->left_child));
+            }
+
+            if(node->right_child == NULL) {
+                LearningState<T> right_state = best.state;
+                right_state.depth += 1;
+                right_state.from = right_state.border;
+                right_state.set_counts_from_right(best.state);
+                candidates.push(unsearched_bestfirst_candidate(right_state, &node->right_child));
+            }
+        }
+
+        return tree;
+    }
+
+
+    static BestFirstCandidate<T> unsearched_bestfirst_candidate(const LearningState<T>& state, Node<T>** slot)
+    {
+        BestFirstCandidate<T> candidate;
+        candidate.state = state;
+        candidate.slot = slot;
+        candidate.searched = false;
+        candidate.gain = weighted_entropy(state.foreground_count, state.total_count);
+        return candidate;
+    }
+
+
+    // sucht das Testobjekt für einen Knoten, sortiert seine Beispiele um und
+    // berechnet mit den Anzahlen aus der Suche, wieviel die Teilung bringt
+    static BestFirstCandidate<T> search_bestfirst_candidate(BestFirstCandidate<T> candidate, SampleStore& samples, NodePool<T>& pool)
+    {
+        LearningState<T>& state = candidate.state;
+        state.node = Node<T>::build_inner_node(state, samples, pool);
+        state.border = partition_samples(samples, state.from, state.to);
+
+        candidate.searched = true;
+        candidate.gain = weighted_entropy(state.foreground_count, state.total_count)
+            - weighted_entropy(state.foreground_left, state.total_left)
+            - weighted_entropy(state.foreground_count - state.foreground_left, state.total_count - state.total_left);
+        return candidate;
+    }
+
+
+    // Variante von train(), bei der der Baum Ebene für Ebene wächst: für alle
+    // Knoten einer Ebene werden die Testobjekte in einem gemeinsamen
+    // Durchlauf über die Trainingsbeispiele ausgewertet, danach werden alle
+    // Knoten der Ebene auf einmal umsortiert. Der Durchlauf wird in Stücke
+    // aufgeteilt, die mit OpenMP parallel abgearbeitet werden. Weil jedes
+    // Beispiel in genau einem Knoten der Ebene liegt, werden wie in
+    // Node::evaluate_block die Ergebnisse jedes Beispiels gespeichert und für
+    // den Gewinner jedes Knotens nach samples.goes_left übernommen; beim
+    // Umsortieren wird also kein Testobjekt noch einmal ausgewertet.
+    static Tree* train_levelwise(TrainingData& labels)
+    {
+        Tree<T>* tree = new Tree;
+
+        SampleStore samples(labels);
+        samples.allocate_outcome_buffers();
+        samples.allocate_partition_buffers();
+        unsigned int* outcomes = samples.block_outcomes.begin();
+        unsigned char* goes_left = samples.goes_left.begin();
+
+        std::vector<FrontierNode<T> > frontier(1);
+        frontier[0].slot = &tree->root;
+        frontier[0].depth = 1;
+        frontier[0].from = 0;
+        frontier[0].to = samples.size() - 1;
+        samples.count(frontier[0].from, frontier[0].to, frontier[0].total_count, frontier[0].foreground_count);
+
+        const unsigned int block_size = T::Block::MAX_SIZE;
+        const unsigned long chunk_size = 16384;
+
+        while(!frontier.empty()) {
+
+            // ist die Zeit um, wird die ganze Ebene zu Blättern
+            if(past_deadline(*samples.settings)) {
+                for(unsigned int k = 0; k < frontier.size(); ++k) {
+                    *(frontier[k].slot) = Node<T>::build_leaf_node(frontier[k].foreground_count, frontier[k].total_count, tree->nodes);
+                }
+                break;
+            }
+
+            std::vector<SplitSearch<T> > searches(frontier.size());
+            std::vector<typename T::Block> blocks(frontier.size());
+
+            while(true) {
+                // für alle Knoten, die noch nicht genug Testobjekte
+                // ausprobiert haben, einen neuen Block auswürfeln
+                std::vector<unsigned int> active;
+                for(unsigned int k = 0; k < frontier.size(); ++k) {
+                    if(searches[k].try_count < samples.parameters->testobject_tries) {
+                        Node<T>::sample_block(blocks[k], searches[k].try_count, *samples.parameters, *samples.random);
+                        blocks[k].prepare(samples.strides, samples.augmentations);
+                        active.push_back(k);
+                    }
+                }
+                if(active.empty()) {
+                    break;
+                }
+
+                // die Beispiele aller aktiven Knoten in Stücke aufteilen
+                std::vector<unsigned int> chunk_nodes;
+                std::vector<unsigned long> chunk_starts;
+                for(unsigned int a = 0; a < active.size(); ++a) {
+                    FrontierNode<T>& f = frontier[active[a]];
+                    for(unsigned long start = f.from; start <= f.to; start += chunk_size) {
+                        chunk_nodes.push_back(a);
+                        chunk_starts.push_back(start);
+                    }
+                }
+
+                std::vector<unsigned long> total_left(active.size() * block_size, 0);
+                std::vector<unsigned long> foreground_left(active.size() * block_size, 0);
+
+#pragma omp parallel num_threads(training_threads(*samples.settings))
+                {
+                    // jeder Thread zählt erst für sich und addiert am Ende
+                    // auf die gemeinsamen Zähler
+                    std::vector<unsigned long> thread_total_left(active.size() * block_size, 0);
+                    std::vector<unsigned long> thread_foreground_left(active.size() * block_size, 0);
+
+#pragma omp for schedule(dynamic)
+                    for(long c = 0; c < static_cast<long>(chunk_nodes.size()); ++c) {
+                        unsigned int a = chunk_nodes[c];
+                        typename T::Block& block = blocks[active[a]];
+                        unsigned long end = std::min(chunk_starts[c] + chunk_size - 1, frontier[active[a]].to);
+                        for(unsigned long i = chunk_starts[c]; i <= end; ++i) {
+                            unsigned long weight = samples.weight(i);
+                            outcomes[i] = block.count_left(samples.source(i), samples.center(i), weight, samples.is_foreground(i) * weight, &thread_total_left[a * block_size], &thread_foreground_left[a * block_size]);
+                        }
+                    }
+
+#pragma omp critical(merge_counts)
+                    for(size_t j = 0; j < total_left.size(); ++j) {
+                        total_left[j] += thread_total_left[j];
+                        foreground_left[j] += thread_foreground_left[j];
+                    }
+                }
+
+                // für jeden Knoten, dessen bisher bestes Testobjekt jetzt
+                // aus diesem Block kommt, dessen Position im Block
+                std::vector<int> winners(active.size(), -1);
+                for(unsigned int a = 0; a < active.size(); ++a) {
+                    unsigned int k = active[a];
+                    for(unsigned int j = 0; j < blocks[k].size; ++j) {
+                        if(searches[k].consider(blocks[k].tests[j], total_left[a * block_size + j], foreground_left[a * block_size + j], frontier[k].total_count, frontier[k].foreground_count)) {
+                            winners[a] = j;
+                        }
+                    }
+                }
+
+#pragma omp parallel for schedule(dynamic) num_threads(training_threads(*samples.settings))
+                for(long c = 0; c < static_cast<long>(chunk_nodes.size()); ++c) {
+                    unsigned int a = chunk_nodes[c];
+                    if(winners[a] < 0) {
+                        continue;
+                    }
+                    unsigned int bit = winners[a];
+                    unsigned long end = std::min(chunk_starts[c] + chunk_size - 1, frontier[active[a]].to);
+                    for(unsigned long i = chunk_starts[c]; i <= end; ++i) {
+                        goes_left[i] = static_cast<unsigned char>((outcomes[i] >> bit) & 1);
+                    }
+                }
+            }
+
+            // Knoten bauen und alle Knoten der Ebene umsortieren
+            std::vector<Node<T>*> nodes(frontier.size());
+            std::vector<unsigned long> borders(frontier.size());
+            for(unsigned int k = 0; k < frontier.size(); ++k) {
+                nodes[k] = Node<T>::build_split_node(searches[k], frontier[k].depth, *samples.parameters, tree->nodes);
+                *(frontier[k].slot) = nodes[k];
+            }
+
+#pragma omp parallel for schedule(dynamic) num_threads(training_threads(*samples.settings))
+            for(long k = 0; k < static_cast<long>(frontier.size()); ++k) {
+                borders[k] = partition_samples(samples, frontier[k].from, frontier[k].to);
+            }
+
+            // die nächste Ebene besteht aus allen Kindknoten, die keine
+            // Blattknoten sind
+            std::vector<FrontierNode<T> > next_frontier;
+            for(unsigned int k = 0; k < frontier.size(); ++k) {
+                if(nodes[k]->left_child == NULL) {
+                    FrontierNode<T> left = frontier[k];
+                    left.slot = &nodes[k]->left_child;
+                    left.depth += 1;
+                    left.to = borders[k] - 1;
+                    left.total_count = searches[k].best_total_pixels_left;
+                    left.foreground_count = searches[k].best_foreground_count_left;
+                    next_frontier.push_back(left);
+                }
+                if(nodes[k]->right_child == NULL) {
+                    FrontierNode<T> right = frontier[k];
+                    right.slot = &nodes[k]->right_child;
+                    right.depth += 1;
+                    right.from = borders[k];
+                    right.total_count = searches[k].best_total_pixels_right;
+                    right.foreground_count = searches[k].best_foreground_count_right;
+                    next_frontier.push_back(right);
+                }
+            }
+            frontier.swap(next_frontier);
+        }
+
+        return tree;
+    }
+
+
+    // Variante von train_levelwise(), bei der der Baum zu einem Dschungel
+    // wird, d.h. zu einem gerichteten azyklischen Graphen (Shotton et al.,
+    // "Decision Jungles", 2013): die Knoten einer Ebene schicken ihre
+    // Beispiele in höchstens jungle_width (siehe TrainingSettings) Knoten der
+    // nächsten Ebene, mehrere Eltern teilen sich also Kindknoten. Weil die
+    // Anzahl der Knoten pro Ebene begrenzt ist, kann ein Dschungel mit
+    // demselben Speicher viel tiefer werden als ein Baum.
+    //
+    // Die Testobjekte und die Zuordnung zu den Kindknoten werden für jede
+    // Ebene gemeinsam optimiert: zuerst bekommt jeder Knoten wie im Baum das
+    // beste Testobjekt, und die Teilmengen links und rechts mit ähnlichem
+    // Anteil an Vordergrundpixeln werden zu Kindknoten zusammengefasst. Dann
+    // wird JUNGLE_ITERATIONS mal abwechselnd für jeden Knoten ein besseres
+    // Testobjekt bei festen Kindknoten gesucht und jede Teilmenge dem
+    // Kindknoten zugeordnet, bei dem die Summe der gewichteten Entropien
+    // aller Kindknoten am kleinsten wird. Diese Summe wird dabei nie größer.
+    static Tree* train_jungle(TrainingData& labels)
+    {
+        Tree<T>* tree = new Tree;
+
+        SampleStore samples(labels);
+        samples.allocate_outcome_buffers();
+        samples.allocate_partition_buffers();
+
+        std::vector<JungleNode<T> > level(1);
+        level[0].from = 0;
+        level[0].to = samples.size() - 1;
+        samples.count(level[0].from, level[0].to, level[0].total_count, level[0].foreground_count);
+        tree->root = Node<T>::build_leaf_node(level[0].foreground_count, level[0].total_count, tree->nodes);
+        tree->jungle_nodes.push_back(tree->root);
+        level[0].node = tree->root;
+        if(level[0].foreground_count == 0 || level[0].foreground_count == level[0].total_count) {
+            level.clear();
+        }
+
+        // die Beispiele aller Knoten der aktuellen Ebene liegen
+        // zusammenhängend in [level_from, level_to]
+        unsigned long level_from = 0;
+        unsigned long level_to = samples.size() - 1;
+
+        for(unsigned short depth = 1; !level.empty(); ++depth) {
+
+            // ist die Zeit um, bleiben die Knoten der Ebene Blätter
+            if(past_deadline(*samples.settings)) {
+                break;
+            }
+
+            // zuerst sucht jeder Knoten sein Testobjekt wie im Baum. Weil
+            // die Knoten parallel suchen, bekommt jeder einen eigenen
+            // Zufallsgenerator, dessen Startwert aus dem des Baums kommt.
+            unsigned long long level_seed = samples.random->next();
+#pragma omp parallel for schedule(dynamic) num_threads(training_threads(*samples.settings))
+            for(long k = 0; k < static_cast<long>(level.size()); ++k) {
+                SplitSearch<T> search;
+                Random node_random(level_seed, k);
+                search_jungle_split(search, level[k], samples, NULL, node_random);
+                level[k].total_left = 0;
+                if(search.found) {
+                    level[k].test = search.best_test;
+                    level[k].total_left = search.best_total_pixels_left;
+                    level[k].foreground_left = search.best_foreground_count_left;
+                    level[k].border = partition_samples(samples, level[k].from, level[k].to);
+                }
+            }
+
+            // Knoten, deren Beispiele sich nicht trennen lassen, bleiben
+            // Blätter
+            std::vector<JungleNode<T> > parents;
+            std::vector<JungleNode<T> > unsplit;
+            for(size_t k = 0; k < level.size(); ++k) {
+                if(level[k].total_left > 0) {
+                    parents.push_back(level[k]);
+                } else {
+                    unsplit.push_back(level[k]);
+                }
+            }
+            if(parents.empty()) {
+                break;
+            }
+
+            unsigned int width = assign_jungle_children(parents, samples.settings->jungle_width);
+            std::vector<unsigned long> child_total(width, 0);
+            std::vector<unsigned long> child_foreground(width, 0);
+            for(size_t k = 0; k < parents.size(); ++k) {
+                child_total[parents[k].left_child] += parents[k].total_left;
+                child_foreground[parents[k].left_child] += parents[k].foreground_left;
+                child_total[parents[k].right_child] += parents[k].total_right();
+                child_foreground[parents[k].right_child] += parents[k].foreground_right();
+            }
+
+            for(unsigned int iteration = 0; iteration < JUNGLE_ITERATIONS; ++iteration) {
+                improve_jungle_splits(parents, samples, child_total, child_foreground);
+                improve_jungle_children(parents, child_total, child_foreground);
+            }
+
+            // wieviele Beispiele (ohne Gewicht) in jedem Kindknoten landen
+            std::vector<unsigned long> child_samples(width, 0);
+            for(size_t k = 0; k < parents.size(); ++k) {
+                child_samples[parents[k].left_child] += parents[k].border - parents[k].from;
+                child_samples[parents[k].right_child] += parents[k].to - parents[k].border + 1;
+            }
+
+            // Kindknoten anlegen (Kindknoten, denen am Ende keine Teilmenge
+            // mehr zugeordnet ist, fallen weg). Die Beispiele der Kindknoten,
+            // die weiter geteilt werden, kommen an den Anfang der Ebene, die
+            // übrigen dahinter, damit die nächste Ebene wieder zusammenhängt.
+            std::vector<Node<T>*> children(width, static_cast<Node<T>*>(NULL));
+            std::vector<unsigned long> offsets(width, 0);
+            std::vector<JungleNode<T> > next_level;
+            unsigned long position = 0;
+            for(int pass = 0; pass < 2; ++pass) {
+                for(unsigned int c = 0; c < width; ++c) {
+                    if(child_samples[c] == 0) {
+                        continue;
+                    }
+                    bool inner = depth < samples.parameters->max_tree_depth && child_foreground[c] > 0 && child_foreground[c] < child_total[c];
+                    if(inner != (pass == 0)) {
+                        continue;
+                    }
+                    children[c] = Node<T>::build_leaf_node(child_foreground[c], child_total[c], tree->nodes);
+                    tree->jungle_nodes.push_back(children[c]);
+                    offsets[c] = position;
+                    if(inner) {
+                        JungleNode<T> child;
+                        child.node = children[c];
+                        child.from = level_from + position;
+                        child.to = child.from + child_samples[c] - 1;
+                        child.total_count = child_total[c];
+                        child.foreground_count = child_foreground[c];
+                        next_level.push_back(child);
+                    }
+                    position += child_samples[c];
+                }
+            }
+            unsigned long next_level_size = 0;
+            for(size_t n = 0; n < next_level.size(); ++n) {
+                next_level_size += next_level[n].to - next_level[n].from + 1;
+            }
+
+            std::vector<unsigned long> destinations(level_to - level_from + 1);
+            for(size_t k = 0; k < parents.size(); ++k) {
+                JungleNode<T>& parent = parents[k];
+                parent.node->set_test_object(parent.test);
+                parent.node->left_child = children[parent.left_child];
+                parent.node->right_child = children[parent.right_child];
+                for(unsigned long i = parent.from; i <= parent.to; ++i) {
+                    destinations[i - level_from] = offsets[i < parent.border ? parent.left_child : parent.right_child]++;
+                }
+            }
+            for(size_t k = 0; k < unsplit.size(); ++k) {
+                for(unsigned long i = unsplit[k].from; i <= unsplit[k].to; ++i) {
+                    destinations[i - level_from] = position++;
+                }
+            }
+            reorder_samples(samples, level_from, destinations);
+
+            level.swap(next_level);
+            level_to = level_from + next_level_size - 1;
+        }
+
+        return tree;
+    }
+
+
+    // fasst die Teilmengen links und rechts von allen Knoten der Ebene zu
+    // höchstens max_width Kindknoten zusammen: nach dem Anteil der
+    // Vordergrundpixel sortiert bekommt jeder Kindknoten ungefähr gleich
+    // viele benachbarte Teilmengen. Gibt die Anzahl der Kindknoten zurück.
+    static unsigned int assign_jungle_children(std::vector<JungleNode<T> >& parents, unsigned int max_width)
+    {
+        unsigned int subsets = 2 * parents.size();
+        unsigned int width = std::min(subsets, max_width);
+
+        std::vector<std::pair<double, unsigned int> > ratios(subsets);
+        for(unsigned int s = 0; s < subsets; ++s) {
+            JungleNode<T>& parent = parents[s / 2];
+            if(s % 2 == 0) {
+                ratios[s] = std::make_pair(static_cast<double>(parent.foreground_left) / parent.total_left, s);
+            } else {
+                ratios[s] = std::make_pair(static_cast<double>(parent.foreground_right()) / parent.total_right(), s);
+            }
+        }
+        std::sort(ratios.begin(), ratios.end());
+
+        for(unsigned int r = 0; r < subsets; ++r) {
+            unsigned int s = ratios[r].second;
+            unsigned int child = static_cast<unsigned int>(static_cast<unsigned long>(r) * width / subsets);
+            if(s % 2 == 0) {
+                parents[s / 2].left_child = child;
+            } else {
+                parents[s / 2].right_child = child;
+            }
+        }
+        return width;
+    }
+
+
+    // sucht für jeden Knoten bei festen Kindknoten ein besseres Testobjekt.
+    // Die Suchen laufen parallel mit den Anzahlen vom Anfang der Runde;
+    // übernommen wird ein neues Testobjekt nur, wenn es mit den aktuellen
+    // Anzahlen (nach den Änderungen bei den Knoten davor) immer noch besser
+    // ist. Knoten, die beide Teilmengen in denselben Kindknoten schicken,
+    // werden übersprungen, weil ihr Testobjekt dort nichts ändert.
+    static void improve_jungle_splits(std::vector<JungleNode<T> >& parents, SampleStore& samples, std::vector<unsigned long>& child_total, std::vector<unsigned long>& child_foreground)
+    {
+        std::vector<SplitSearch<T> > searches(parents.size());
+
+        unsigned long long round_seed = samples.random->next();
+#pragma omp parallel for schedule(dynamic) num_threads(training_threads(*samples.settings))
+        for(long k = 0; k < static_cast<long>(parents.size()); ++k) {
+            JungleNode<T>& parent = parents[k];
+            if(parent.left_child == parent.right_child) {
+                continue;
+            }
+            SplitSearch<T>& search = searches[k];
+            search.base_total_left = child_total[parent.left_child] - parent.total_left;
+            search.base_foreground_left = child_foreground[parent.left_child] - parent.foreground_left;
+            search.base_total_right = child_total[parent.right_child] - parent.total_right();
+            search.base_foreground_right = child_foreground[parent.right_child] - parent.foreground_right();
+            Random node_random(round_seed, k);
+            search_jungle_split(search, parent, samples, &parent.test, node_random);
+        }
+
+        std::vector<char> changed(parents.size(), 0);
+        for(size_t k = 0; k < parents.size(); ++k) {
+            JungleNode<T>& parent = parents[k];
+            SplitSearch<T>& search = searches[k];
+            if(!search.found || (search.best_total_pixels_left == parent.total_left && search.best_foreground_count_left == parent.foreground_left)) {
+                continue;
+            }
+
+            unsigned int l = parent.left_child;
+            unsigned int r = parent.right_child;
+            unsigned long total_left = child_total[l] - parent.total_left + search.best_total_pixels_left;
+            unsigned long foreground_left = child_foreground[l] - parent.foreground_left + search.best_foreground_count_left;
+            unsigned long total_right = child_total[r] - parent.total_right() + search.best_total_pixels_right;
+            unsigned long foreground_right = child_foreground[r] - parent.foreground_right() + search.best_foreground_count_right;
+            double before = weighted_entropy(child_foreground[l], child_total[l]) + weighted_entropy(child_foreground[r], child_total[r]);
+            double after = weighted_entropy(foreground_left, total_left) + weighted_entropy(foreground_right, total_right);
+            if(after >= before - 1e-9) {
+                continue;
+            }
+
+            child_total[l] = total_left;
+            child_foreground[l] = foreground_left;
+            child_total[r] = total_right;
+            child_foreground[r] = foreground_right;
+            parent.test = search.best_test;
+            parent.total_left = search.best_total_pixels_left;
+            parent.foreground_left = search.best_foreground_count_left;
+            changed[k] = 1;
+        }
+
+#pragma omp parallel for schedule(dynamic) num_threads(training_threads(*samples.settings))
+        for(long k = 0; k < static_cast<long>(parents.size()); ++k) {
+            if(changed[k]) {
+                parents[k].border = partition_samples(samples, parents[k].from, parents[k].to);
+            }
+        }
+    }
+
+
+    // ordnet jede Teilmenge dem Kindknoten zu, bei dem die Summe der
+    // gewichteten Entropien am kleinsten wird. Die beiden Teilmengen eines
+    // Knotens kommen dabei nicht in denselben Kindknoten.
+    static void improve_jungle_children(std::vector<JungleNode<T> >& parents, std::vector<unsigned long>& child_total, std::vector<unsigned long>& child_foreground)
+    {
+        for(size_t k = 0; k < parents.size(); ++k) {
+            for(int side = 0; side < 2; ++side) {
+                JungleNode<T>& parent = parents[k];
+                unsigned int& child = (side == 0 ? parent.left_child : parent.right_child);
+                unsigned int sibling = (side == 0 ? parent.right_child : parent.left_child);
+                unsigned long total = (side == 0 ? parent.total_left : parent.total_right());
+                unsigned long foreground = (side == 0 ? parent.foreground_left : parent.foreground_right());
+
+                child_total[child] -= total;
+                child_foreground[child] -= foreground;
+
+                unsigned int best_child = child;
+                double best_change = weighted_entropy(child_foreground[child] + foreground, child_total[child] + total) - weighted_entropy(child_foreground[child], child_total[child]);
+                for(unsigned int c = 0; c < child_total.size(); ++c) {
+                    if(c == child || c == sibling) {
+                        continue;
+                    }
+                    double change = weighted_entropy(child_foreground[c] + foreground, child_total[c] + total) - weighted_entropy(child_foreground[c], child_total[c]);
+                    if(change < best_change - 1e-9) {
+                        best_change = change;
+                        best_child = c;
+                    }
+                }
+
+                child = best_child;
+                child_total[child] += total;
+                child_foreground[child] += foreground;
+            }
+        }
+    }
+
+
+    // sucht das beste Testobjekt für einen Knoten des Dschungels. current
+    // (kann NULL sein) wird zuerst bewertet, so wird das Ergebnis nicht
+    // schlechter als das bisherige Testobjekt. Trennt kein Testobjekt die
+    // Beispiele (z.B. weil sie alle gleich aussehen), wird nach
+    // 100-mal so vielen Versuchen wie sonst aufgegeben.
+    static void search_jungle_split(SplitSearch<T>& search, JungleNode<T>& parent, SampleStore& samples, const T* current, Random& random)
+    {
+        typename T::Block block;
+        if(current != NULL) {
+            block.size = 1;
+            block.tests[0] = *current;
+            evaluate_jungle_block(block, search, parent, samples);
+        }
+
+        const ForestParameters& parameters = *samples.parameters;
+        unsigned long sampled = 0;
+        while(search.try_count < parameters.testobject_tries && sampled < 100ul * parameters.testobject_tries) {
+            Node<T>::sample_block(block, search.try_count, parameters, random);
+            sampled += block.size;
+            evaluate_jungle_block(block, search, parent, samples);
+        }
+    }
+
+
+    // wie Node::evaluate_block, aber ohne Abbrechen. Auch hier kommen die
+    // Ergebnisse des Gewinners nach samples.goes_left, damit die Beispiele
+    // ohne neue Auswertung aufgeteilt werden können.
+    static void evaluate_jungle_block(typename T::Block& block, SplitSearch<T>& search, JungleNode<T>& parent, SampleStore& samples)
+    {
+        unsigned long total_left[T::Block::MAX_SIZE];
+        unsigned long foreground_left[T::Block::MAX_SIZE];
+        std::fill(total_left, total_left + T::Block::MAX_SIZE, 0ul);
+        std::fill(foreground_left, foreground_left + T::Block::MAX_SIZE, 0ul);
+
+        unsigned int* outcomes = samples.block_outcomes.begin();
+        block.prepare(samples.strides, samples.augmentations);
+        for(unsigned long i = parent.from; i <= parent.to; ++i) {
+            unsigned long weight = samples.weight(i);
+            outcomes[i] = block.count_left(samples.source(i), samples.center(i), weight, samples.is_foreground(i) * weight, total_left, foreground_left);
+        }
+
+        int winner = -1;
+        for(unsigned int j = 0; j < block.size; ++j) {
+            if(search.consider(block.tests[j], total_left[j], foreground_left[j], parent.total_count, parent.foreground_count)) {
+                winner = j;
+            }
+        }
+
+        if(winner >= 0) {
+            for(unsigned long i = parent.from; i <= parent.to; ++i) {
+                samples.goes_left[i] = static_cast<unsigned char>((outcomes[i] >> winner) & 1);
+            }
+        }
+    }
+
+
+    static Tree* from_json(JSONValue* json_value, const ForestParameters& parameters)
+    {
+        Tree<T>* tree = new Tree;
+        if(!json_value->IsObject()) {
+            tree->root = Node<T>::from_json(json_value, parameters, tree->nodes);
+            return tree;
+        }
+
+        // ein Dschungel (siehe to_json): erst alle Knoten anlegen, damit die
+        // Indizes der Kindknoten aufgelöst werden können
+        JSONObject object = json_value->AsObject();
+        JSONArray node_array = object[L"Jungle"]->AsArray();
+        for(size_t i = 0; i < node_array.size(); ++i) {
+            tree->jungle_nodes.push_back(tree->nodes.allocate());
+        }
+        for(size_t i = 0; i < node_array.size(); ++i) {
+            Node<T>* node = tree->jungle_nodes[i];
+            if(node_array[i]->IsArray() && node_array[i]->AsArray().size() >= 3) {
+                const JSONArray& array = node_array[i]->AsArray();
+                node->set_test_object(T::from_json(array[0], parameters));
+                node->left_child = tree->jungle_nodes.at(static_cast<size_t>(array[1]->AsNumber()));
+                node->right_child = tree->jungle_nodes.at(static_cast<size_t>(array[2]->AsNumber()));
+                if(array.size() >= 4) {
+                    node->set_leaf_info(LeafInfo::from_json(array[3]));
+                }
+            } else {
+                node->set_leaf_info(LeafInfo::from_json(node_array[i]));
+            }
+        }
+        tree->root = tree->jungle_nodes.at(0);
+        return tree;
+    }
+
+
+    // Ein Dschungel würde als verschachteltes Array jeden Knoten so oft
+    // enthalten, wie es Wege zu ihm gibt. Er wird deshalb als
+    // {"Jungle": [Knoten, ...]} mit der Wurzel zuerst gespeichert, ein
+    // innerer Knoten ist dort [Testobjekt, Index links, Index rechts,
+    // Anzahlen] und ein Blatt wie im Baum.
+    JSONValue* to_json()
+    {
+        if(jungle_nodes.empty()) {
+            return this->root->to_json();
+        }
+
+        std::map<Node<T>*, size_t> indices;
+        for(size_t i = 0; i < jungle_nodes.size(); ++i) {
+            indices[jungle_nodes[i]] = i;
+        }
+
+        JSONArray node_array;
+        for(size_t i = 0; i < jungle_nodes.size(); ++i) {
+            Node<T>* node = jungle_nodes[i];
+            if(node->test_object == NULL) {
+                node_array.push_back(node->leaf_info->to_json());
+                continue;
+            }
+            JSONArray inner;
+            inner.push_back(node->test_object->to_json());
+            inner.push_back(new JSONValue(static_cast<double>(indices[node->left_child])));
+            inner.push_back(new JSONValue(static_cast<double>(indices[node->right_child])));
+            if(node->leaf_info != NULL && node->leaf_info->total_count > 0) {
+                inner.push_back(node->leaf_info->to_json());
+            }
+            node_array.push_back(new JSONValue(inner));
+        }
+
+        JSONObject object;
+        object[L"Jungle"] = new JSONValue(node_array);
+        return new JSONValue(object);
+    }
+
+
+    LeafInfo* inference(CImg<unsigned char>& image, unsigned int x, unsigned int y)
+    {
+        Node<T>* current_node = this->root;
+        while(current_node->test_object != NULL) {
+            if(current_node->test_object->goes_left(&image, x, y))
+                current_node = current_node->left_child;
+            else
+                current_node = current_node->right_child;
+        }
+
+        return current_node->leaf_info;
+    }
+
+
+    // wie oben, aber mit den schon berechneten Differenzen aller Paare aus
+    // dem Offset-Pool: die Differenz für das Paar k steht in
+    // differences[k * stride]. Geht nur, wenn in_offset_pool() true ist.
+    LeafInfo* inference(const short* differences, unsigned int stride)
+    {
+        Node<T>* current_node = this->root;
+        while(current_node->test_object != NULL) {
+            if(differences[current_node->test_object->pool_index * stride] < current_node->test_object->difference_threshold)
+                current_node = current_node->left_child;
+            else
+                current_node = current_node->right_child;
+        }
+
+        return current_node->leaf_info;
+    }
+
+
+    bool in_offset_pool()
+    {
+        if(jungle_nodes.empty()) {
+            return this->root->in_offset_pool();
+        }
+        for(size_t i = 0; i < jungle_nodes.size(); ++i) {
+            if(jungle_nodes[i]->test_object != NULL && jungle_nodes[i]->test_object->pool_index < 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    // Nachtrainieren: die inneren Knoten bleiben, wie sie sind, aber die
+    // gelabelten Pixel werden durch den Baum geschickt und in allen Knoten
+    // auf ihrem Weg gezählt. Mit keep_counts werden die neuen Anzahlen zu den
+    // alten addiert, sonst ersetzen sie sie.
+    void refit(TrainingData& labels, bool keep_counts)
+    {
+        if(!keep_counts) {
+            if(jungle_nodes.empty()) {
+                this->root->reset_counts();
+            }
+            for(size_t i = 0; i < jungle_nodes.size(); ++i) {
+                if(jungle_nodes[i]->leaf_info != NULL) {
+                    jungle_nodes[i]->leaf_info->foreground_count = 0;
+                    jungle_nodes[i]->leaf_info->total_count = 0;
+                }
+            }
+        }
+
+        for(SelectedPixels pixel(labels); pixel.next(); ) {
+            if(pixel.label == 0) {
+                continue;
+            }
+            CImg<unsigned char>& image = *(labels.training_images[pixel.image]);
+            unsigned long is_foreground = (pixel.label == 2);
+            Node<T>* current_node = this->root;
+            while(true) {
+                if(current_node->leaf_info != NULL) {
+                    current_node->leaf_info->total_count += 1;
+                    current_node->leaf_info->foreground_count += is_foreground;
+                }
+                if(current_node->test_object == NULL) {
+                    break;
+                }
+                if(current_node->test_object->goes_left(&image, pixel.x, pixel.y))
+                    current_node = current_node->left_child;
+                else
+                    current_node = current_node->right_child;
+            }
+        }
 
-    bool goes_left(CImg<unsigned char>* image, unsigned int x, unsigned int y)
-    {
-        return (*image)(x + offset_x, y + offset_y) < threshold;
+        if(jungle_nodes.empty()) {
+            this->root->update_probabilities();
+        }
+        for(size_t i = 0; i < jungle_nodes.size(); ++i) {
+            if(jungle_nodes[i]->leaf_info != NULL) {
+                jungle_nodes[i]->leaf_info->update_probability();
+            }
+        }
     }
 
-    static AxisAlignedTest* sample()
+
+    // ob truncate gehen würde, ohne etwas zu ändern (siehe
+    // Node::can_truncate)
+    bool can_truncate(unsigned short max_depth) const
     {
-        AxisAlignedTest* testobject = new AxisAlignedTest;
-        testobject->offset_x = (std::rand() % WINDOW_SIZE) - WINDOW_RADIUS;
-        testobject->offset_y = (std::rand() % WINDOW_SIZE) - WINDOW_RADIUS;
-        testobject->threshold = std::rand() % 256;
-        return testobject;
+        if(jungle_nodes.empty()) {
+            return this->root->can_truncate(1, max_depth);
+        }
+
+        // die Tiefen wie in truncate, aber nur geprüft
+        std::map<Node<T>*, unsigned short> depths;
+        depths[this->root] = 1;
+        for(size_t i = 0; i < jungle_nodes.size(); ++i) {
+            Node<T>* node = jungle_nodes[i];
+            typename std::map<Node<T>*, unsigned short>::iterator it = depths.find(node);
+            if(it == depths.end() || node->test_object == NULL) {
+                continue;
+            }
+            if(it->second > max_depth) {
+                if(node->leaf_info == NULL || node->leaf_info->total_count == 0) {
+                    return false;
+                }
+                continue;
+            }
+            depths[node->left_child] = it->second + 1;
+            depths[node->right_child] = it->second + 1;
+        }
+        return true;
     }
 
 
-    JSONValue* to_json()
+    // schneidet den Baum auf die Tiefe max_depth ab. Gibt false zurück und
+    // ändert nichts, wenn can_truncate nicht geht.
+    bool truncate(unsigned short max_depth)
     {
-        JSONArray array;
-        array.push_back(new JSONValue(static_cast<double>(offset_x)));
-        array.push_back(new JSONValue(static_cast<double>(offset_y)));
-        array.push_back(new JSONValue(static_cast<double>(threshold)));
-        return new JSONValue(array);
-    }
+        if(!can_truncate(max_depth)) {
+            return false;
+        }
+        if(jungle_nodes.empty()) {
+            this->root->truncate(1, max_depth);
+            return true;
+        }
 
+        // wie Node::truncate für einen Dschungel. Die Knoten stehen Ebene für
+        // Ebene in der Liste, die Tiefe eines Knotens ist also immer schon
+        // bekannt, wenn er an die Reihe kommt. Knoten, die nicht mehr
+        // erreichbar sind, fallen aus der Liste.
+        std::map<Node<T>*, unsigned short> depths;
+        depths[this->root] = 1;
+        std::vector<Node<T>*> kept;
+        for(size_t i = 0; i < jungle_nodes.size(); ++i) {
+            Node<T>* node = jungle_nodes[i];
+            typename std::map<Node<T>*, unsigned short>::iterator it = depths.find(node);
+            if(it == depths.end()) {
+                continue;
+            }
+            kept.push_back(node);
+            if(node->test_object == NULL) {
+                continue;
+            }
+            if(it->second > max_depth) {
+                node->test_object = NULL;
+                node->left_child = NULL;
+                node->right_child = NULL;
+                continue;
+            }
+            depths[node->left_child] = it->second + 1;
+            depths[node->right_child] = it->second + 1;
+        }
+        jungle_nodes.swap(kept);
+        return true;
+    }
 };
 
-std::wstring AxisAlignedTest::name = L"AxisAlignedTest";
-
-*/
-
 
 
 
 
 
-// notwendige Forward declarations
-template <typename T>
-class Node;
 
-template <typename T>
-class Tree;
 
 
-// während der Entscheidungsbaum aufgebaut wird, wird eine Liste von solchen
-// LearningState-Objekten verwaltet
-// So ein Objekt repräsentiert einen Knoten im Baum, für den bereits ein
-// Testobjekt gelernt wurde, der aber noch keine Kindknoten hat
+// Ein Farn (Random Fern) ist die Alternative zu einem Entscheidungsbaum
+// (siehe ForestParameters::model_type): eine feste Folge von so vielen
+// Testobjekten, wie die maximale Tiefe angibt, deren
+// Ergebnisse zusammen einen Index mit so vielen Bits in eine Tabelle mit den
+// Anzahlen der Trainingspixel ergeben. Weil der nächste Test nicht vom
+// Ergebnis des vorigen abhängt, ist das Training ein einziger Durchlauf zum
+// Zählen, und die Inferenz kommt ohne Verzweigungen aus. Dafür braucht ein
+// Farn für dieselbe Genauigkeit meist mehr Tests als ein Baum tief ist.
 template <typename T>
-struct LearningState
+class Fern
 {
-    Node<T>* node;
 
-    // Tiefe des Knotens im Baum
-    unsigned short depth;
+public:
+    std::vector<T> tests;
+    std::vector<LeafInfo> bins;
+
+    // log(p / (1 - p)) für die Wahrscheinlichkeit p jedes Tabellenfelds
+    // (siehe Forest::fern_inference)
+    std::vector<float> log_odds;
 
-    unsigned long from;
-    unsigned long border;
-    unsigned long to;
-};
 
+    // die Testobjekte werden nur ausgewürfelt, nicht ausgewählt. Als
+    // Schwellwert bekommt jedes die Differenz an einem zufälligen gelabelten
+    // Pixel, damit die Tests die Pixel auch wirklich aufteilen.
+    static Fern* train(TrainingData& labels)
+    {
+        Fern<T>* fern = new Fern;
+        std::vector<unsigned long> threshold_pixels;
+        for(unsigned short i = 0; i < labels.parameters->max_tree_depth; ++i) {
+            fern->tests.push_back(T::sample(*labels.parameters, labels.random));
+            threshold_pixels.push_back(labels.random.index(labels.number_of_labeled_pixels));
+        }
 
+        unsigned long labeled_pixel = 0;
+        for(SelectedPixels pixel(labels); pixel.next(); ) {
+            if(pixel.label == 0) {
+                continue;
+            }
+            CImg<unsigned char>& image = *(labels.training_images[pixel.image]);
+            for(size_t j = 0; j < fern->tests.size(); ++j) {
+                if(threshold_pixels[j] == labeled_pixel) {
+                    fern->tests[j].difference_threshold = fern->tests[j].difference(image.data(pixel.x, pixel.y), image.width());
+                }
+            }
+            ++labeled_pixel;
+        }
 
+        fern->bins.resize(1ul << fern->tests.size());
+        fern->refit(labels, false);
+        return fern;
+    }
 
 
-template <typename T>
-class Node {
+    // der Index in bins für ein Pixel; das erste Testobjekt ist das höchste
+    // Bit
+    unsigned long index(CImg<unsigned char>& image, unsigned int x, unsigned int y)
+    {
+        const unsigned char* center = image.data(x, y);
+        unsigned long bin = 0;
+        for(size_t i = 0; i < tests.size(); ++i) {
+            bin = (bin << 1) | static_cast<unsigned long>(!tests[i].goes_left(center, image.width()));
+        }
+        return bin;
+    }
 
-public:
-    // linker und rechter Kindknoten
-    Node* left_child;
-    Node* right_child;
 
-    // ein Knoten kann entweder ein innerer Knoten sein (dann hat er ein
-    // test_object und leaf_info ist NULL) oder ein Blattknoten (dann
-    // umgekehrt)
-    T* test_object;
-    LeafInfo* leaf_info;
+    // wie oben, aber mit den schon berechneten Differenzen aller Paare aus
+    // dem Offset-Pool (siehe Tree::inference)
+    unsigned long index(const short* differences, unsigned int stride)
+    {
+        unsigned long bin = 0;
+        for(size_t i = 0; i < tests.size(); ++i) {
+            bin = (bin << 1) | static_cast<unsigned long>(differences[tests[i].pool_index * stride] >= tests[i].difference_threshold);
+        }
+        return bin;
+    }
 
 
-    ~Node() {
-        delete leaf_info;
-        delete test_object;
-        delete left_child;
-        delete right_child;
+    bool in_offset_pool()
+    {
+        for(size_t i = 0; i < tests.size(); ++i) {
+            if(tests[i].pool_index < 0) {
+                return false;
+            }
+        }
+        return true;
     }
 
 
-    // baut und gibt einen neuen Knoten zurück, der die Pixel am besten trennt
-    // Das funktioniert, indem eine Anzahl von Testobjekten zufällig erzeugt
-    // wird. Mit jedem davon trennt man die Trainingspixel, die an diesem
-    // Knoten ankommen und misst in den entstandenen Teilmengen das Verhältnis
-    // von Vordergrund- zu Hintergrundpixeln. Je ungleicher das Verhältnis,
-    // desto besser. Das beste Trainingsobjekt wird für diesen Knoten genommen.
-    static Node<T>* build_inner_node(TrainingData& labels, LearningState<T>& state, std::vector<unsigned int>& samples)
-    {
-
-        double lowest_expected_entropy = std::numeric_limits<double>::infinity();
-        T* best_test = NULL;
-
-        // wieviele Trainingsbeispiele das beste Testobjekt insgesamt nach
-        // rechts bzw. links schickt und wieviele davon Vordergrundpixel sind
-        unsigned long best_total_pixels_left = 0;
-        unsigned long best_total_pixels_right = 0;
-        unsigned long best_foreground_count_left = 0;
-        unsigned long best_foreground_count_right = 0;
-
-        // wird true, wenn dieser Knoten die Trainingsbeispiele perfekt trennt,
-        // d.h. alle Pixel, die tatsächlich zum Vordergrund gehören, werden auf
-        // die eine Seite und alle anderen auf die andere Seite geschickt
-        bool low_entropy_left = false;
-        bool low_entropy_right = false;
-
-
-        for(unsigned int try_count = 0; try_count < TESTOBJECT_TRIES; ++try_count) {
-
-            T* random_test_object = T::sample();
-
-            // zählt, wieviele Trainingsbeispiele dieses Testobjekt nach links
-            // bzw. rechts schickt und wieviele davon Vordergrundpixel sind
-            unsigned long total_left = 0;
-            unsigned long total_right = 0;
-            unsigned long foreground_left = 0;
-            unsigned long foreground_right = 0;
-
-            // über alle Trainingsbeispiele iterieren, mit denen dieser Knoten
-            // trainiert werden soll
-            for(unsigned int i = state.from; i <= state.to; i += 3) {
-                unsigned int idx = samples[i];
-                unsigned int x = samples[i+1];
-                unsigned int y = samples[i+2];
-
-                if(random_test_object->goes_left(labels.training_images[idx], x, y)) {
-                    // zählen, wieviele der Trainingspixel links landen und
-                    // wieviele davon Vordergrundpixel sind. (Vordergrundpixel
-                    // haben in der Maske den Wert 2, d.h. der Zähler wird hier
-                    // um 1 hochgezählt)
-                    foreground_left += (*(labels.label_masks[idx]))(x, y) - 1;
-                    total_left++;
-                } else {
-                    foreground_right += (*(labels.label_masks[idx]))(x, y) - 1;
-                    total_right++;
-                }
+    // zählt die gelabelten Pixel in den Tabellenfeldern (wie Tree::refit)
+    void refit(TrainingData& labels, bool keep_counts)
+    {
+        if(!keep_counts) {
+            for(size_t i = 0; i < bins.size(); ++i) {
+                bins[i].foreground_count = 0;
+                bins[i].total_count = 0;
+                bins[i].foreground_probability = 0.5;
             }
+        }
 
-            // Wenn das Trainingsobjekt die Beispiele gar nicht trennt, sondern
-            // alle auf eine Seite sortiert, samplen wir nochmal
-            // TODO: gerät in eine Endlosschleife, wenn die Beispiele gar nicht
-            // trennbar sind, z.B. weil sie identisch sind
-            if(total_left == 0 || total_right == 0) {
-                --try_count;
-                delete random_test_object;
+        for(SelectedPixels pixel(labels); pixel.next(); ) {
+            if(pixel.label == 0) {
                 continue;
             }
+            LeafInfo& bin = bins[index(*(labels.training_images[pixel.image]), pixel.x, pixel.y)];
+            bin.total_count += 1;
+            bin.foreground_count += (pixel.label == 2);
+        }
 
+        update_probabilities();
+    }
 
-            // die Entropie (quasi die Ungleichverteilung) der Verteilung der
-            // beiden Klassen VG und HG an den Ausgängen rechts und links
-            // ausrechnen
-            double entropy_left = 0.0;
-            double entropy_right = 0.0;
-
-            if(foreground_left > 0 && foreground_left < total_left) {
-                double p = static_cast<double>(foreground_left) / total_left;
-#ifdef _WIN32
-                // unter Windows gibts die Funktion log2() nicht
-                entropy_left = - ((p * log(p) + (1.0 - p) * log(1.0 - p)) / log(2.0));
-#else
-                entropy_left = - (p * log2(p) + (1.0 - p) * log2(1.0 - p));
-#endif
-            }
-            if(foreground_right > 0 && foreground_right < total_right) {
-                double p = static_cast<double>(foreground_right) / total_right;
-#ifdef _WIN32
-                entropy_right = - ((p * log(p) + (1.0 - p) * log(1.0 - p)) / log(2.0));
-#else
-                entropy_right = - (p * log2(p) + (1.0 - p) * log2(1.0 - p));
-#endif
-            }
 
-            // daraus die durchschnittliche erwartete Entropie berechnen (ohne
-            // zu normalisieren, weil wir nur das Minimum davon wollen)
-            double expected_entropy = static_cast<double>(total_left) * entropy_left +
-                static_cast<double>(total_right) * entropy_right;
-
-            if(expected_entropy < lowest_expected_entropy) {
-                lowest_expected_entropy = expected_entropy;
-                delete best_test;
-                best_test = random_test_object;
-                // wenn rechts oder links nur Beispiele aus einer einzigen
-                // Klasse ankommen, ist die Entropie dort 0. In diesem Fall
-                // machen wir auf der Seite einen Blattknoten
-                low_entropy_left = (entropy_left == 0.0);
-                low_entropy_right = (entropy_right == 0.0);
-                best_foreground_count_left = foreground_left;
-                best_foreground_count_right = foreground_right;
-                best_total_pixels_left = total_left;
-                best_total_pixels_right = total_right;
-            } else {
-                delete random_test_object;
+    // Ein Farn hat viel mehr Tabellenfelder als ein Baum Blätter, in vielen
+    // landen also nur wenige Pixel. Deshalb wird zu beiden Anzahlen ein
+    // Pixel dazugezählt (Laplace-Glättung). Felder ohne Pixel haben 0.5,
+    // weil die Trainingsdaten ungefähr gleich viele Vorder- und
+    // Hintergrundpixel enthalten.
+    void update_probabilities()
+    {
+        log_odds.resize(bins.size());
+        for(size_t i = 0; i < bins.size(); ++i) {
+            if(bins[i].total_count > 0) {
+                bins[i].foreground_probability = (bins[i].foreground_count + 1.0) / (bins[i].total_count + 2.0);
             }
+            log_odds[i] = static_cast<float>(log(bins[i].foreground_probability / (1.0 - bins[i].foreground_probability)));
         }
+    }
 
 
-        Node<T>* new_node = new Node;
-        new_node->leaf_info = NULL;
-        new_node->left_child = NULL;
-        new_node->right_child = NULL;
-        new_node->test_object = best_test;
-
+    // in der JSON-Datei ist ein Farn [[Testobjekte], [Tabellenfelder]], die
+    // Felder im selben Format wie die Blätter der Bäume
+    static Fern* from_json(JSONValue* json_value, const ForestParameters& parameters)
+    {
+        JSONArray array = json_value->AsArray();
+        JSONArray test_array = array[0]->AsArray();
+        JSONArray bin_array = array[1]->AsArray();
 
-        // an new_node links einen Blattknoten anhängen, wenn die maximale
-        // Tiefe erreicht ist oder die Entropie dort 0 ist
-        if(low_entropy_left || state.depth >= MAX_TREE_DEPTH) {
-            new_node->left_child = build_leaf_node(best_foreground_count_left, best_total_pixels_left);
+        Fern<T>* fern = new Fern;
+        for(size_t i = 0; i < test_array.size(); ++i) {
+            fern->tests.push_back(T::from_json(test_array[i], parameters));
         }
-
-        // ebenso rechts
-        if(low_entropy_right || state.depth >= MAX_TREE_DEPTH) {
-            new_node->right_child = build_leaf_node(best_foreground_count_right, best_total_pixels_right);
+        if(bin_array.size() != (1ul << fern->tests.size())) {
+            std::cerr << "Fehler: Ein Farn mit " << fern->tests.size() << " Testobjekten hat " << bin_array.size() << " statt " << (1ul << fern->tests.size()) << " Tabellenfelder" << std::endl;
+            std::exit(1);
+        }
+        for(size_t i = 0; i < bin_array.size(); ++i) {
+            fern->bins.push_back(LeafInfo::from_json(bin_array[i]));
         }
+        fern->update_probabilities();
+        return fern;
+    }
 
-        return new_node;
+
+    JSONValue* to_json()
+    {
+        JSONArray test_array;
+        for(size_t i = 0; i < tests.size(); ++i) {
+            test_array.push_back(tests[i].to_json());
+        }
+        JSONArray bin_array;
+        for(size_t i = 0; i < bins.size(); ++i) {
+            bin_array.push_back(bins[i].to_json());
+        }
+        JSONArray array;
+        array.push_back(new JSONValue(test_array));
+        array.push_back(new JSONValue(bin_array));
+        return new JSONValue(array);
     }
+};
+
+
+
+// Schätzung der Qualität des Walds ohne eigene Validierungsbilder: jeder
+// Baum wird nach dem Training auf alle gelabelten Pixel angewendet, mit denen
+// er nicht trainiert wurde (die nicht ausgewählten Hintergrundpixel und die
+// mit out_of_bag_fraction zurückgehaltenen Vordergrundpixel). Ein Pixel gilt
+// als Vordergrund, wenn die mittlere Wahrscheinlichkeit dieser Bäume über
+// 0.5 liegt. Anders als bei der Inferenz werden die Nachbarpixel nicht
+// berücksichtigt (kein Maxflow), das F-Maß ist also eher etwas niedriger.
+//
+// Die nicht gesehenen Pixel sind keine gleichmäßige Stichprobe: vom
+// Hintergrund fehlen vor allem die Pixel im Band, und Hintergrund gibt es
+// darunter viel mehr als Vordergrund. Deshalb werden in add_to_json für
+// jedes Bild und jede Pixelklasse (Vordergrund, Band, übriger Hintergrund)
+// erst die Anteile der Ergebnisse bestimmt und dann mit der Anzahl aller
+// Pixel dieser Klasse gewichtet. Die Konfusionsmatrix schätzt so die auf
+// allen gelabelten Pixeln. Hat keins der Pixel einer Hintergrundklasse
+// gefehlt (z.B. wenn das Band kleiner als der Vordergrund ist), zählen ihre
+// Pixel zur anderen Hintergrundklasse.
+class OutOfBagEstimate
+{
+
+public:
+    // pro Trainingsbild und Pixel die Summe der Wahrscheinlichkeiten und die
+    // Anzahl der Bäume, die das Pixel nicht gesehen haben. Beim Auslagern
+    // liegen alle Bilder zusammen in mapped_planes.
+    std::vector<CImg<float>*> probability_sums;
+    std::vector<CImg<unsigned short>*> votes;
+    MappedFile mapped_planes;
 
+    unsigned short number_of_trees;
 
-    static Node<T>* build_leaf_node(unsigned long foreground_count, unsigned long total)
+    // der zurückgehaltene Anteil der Vordergrundpixel (siehe
+    // TrainingSettings::out_of_bag_fraction)
+    double out_of_bag_fraction;
+
+
+    // mit out_of_core_prefix werden die Bilder ausgelagert (siehe
+    // TrainingSettings::out_of_core_prefix)
+    OutOfBagEstimate(LabeledImages& data, double out_of_bag_fraction, const std::string& out_of_core_prefix)
     {
-        Node<T>* new_leaf = new Node<T>;
-        new_leaf->left_child = NULL;
-        new_leaf->right_child = NULL;
-        new_leaf->test_object = NULL;
-        new_leaf->leaf_info = new LeafInfo;
+        number_of_trees = 0;
+        this->out_of_bag_fraction = out_of_bag_fraction;
 
-        // foreground_probability ist einfach die Anzahl der ankommenden
-        // Vordergrundpixel geteilt durch die Gesamtzahl der ankommenden Pixel
-        new_leaf->leaf_info->foreground_probability = static_cast<double>(foreground_count) / static_cast<double>(total);
+        if(out_of_core_prefix.empty()) {
+            for(unsigned int i = 0; i < data.training_images.size(); ++i) {
+                probability_sums.push_back(new CImg<float>(data.training_images[i]->width(), data.training_images[i]->height(), 1, 1, 0.0f));
+                votes.push_back(new CImg<unsigned short>(data.training_images[i]->width(), data.training_images[i]->height(), 1, 1, 0));
+            }
+            return;
+        }
 
-        return new_leaf;
+        // erst die Summen aller Bilder, dann die Anzahlen; die Datei ist am
+        // Anfang mit Nullen gefüllt
+        size_t number_of_pixels = 0;
+        for(unsigned int i = 0; i < data.training_images.size(); ++i) {
+            number_of_pixels += data.training_images[i]->width() * data.training_images[i]->height();
+        }
+        mapped_planes.create_temporary(out_of_core_prefix + ".oob", number_of_pixels * (sizeof(float) + sizeof(unsigned short)));
+        float* sums = reinterpret_cast<float*>(mapped_planes.data);
+        unsigned short* counts = reinterpret_cast<unsigned short*>(sums + number_of_pixels);
+        for(unsigned int i = 0; i < data.training_images.size(); ++i) {
+            const int width = data.training_images[i]->width();
+            const int height = data.training_images[i]->height();
+            probability_sums.push_back(new CImg<float>(sums, width, height, 1, 1, true));
+            votes.push_back(new CImg<unsigned short>(counts, width, height, 1, 1, true));
+            sums += width * height;
+            counts += width * height;
+        }
     }
 
 
-    static Node<T>* from_json(JSONValue* json_value)
+    ~OutOfBagEstimate()
     {
-        Node<T>* new_node = new Node<T>;
-        if(json_value->IsArray()) { // ein innerer Knoten
-            JSONArray array = json_value->AsArray();
-            new_node->test_object = T::from_json(array[0]);
-            new_node->left_child = Node<T>::from_json(array[1]);
-            new_node->right_child = Node<T>::from_json(array[2]);
-            new_node->leaf_info = NULL;
-        } else { // Blattknoten
-            new_node->test_object = NULL;
-            new_node->left_child = NULL;
-            new_node->right_child = NULL;
-            new_node->leaf_info = LeafInfo::from_json(json_value);
+        for(unsigned int i = 0; i < probability_sums.size(); ++i) {
+            delete probability_sums[i];
+            delete votes[i];
         }
-        return new_node;
     }
 
 
-    JSONValue* to_json()
+    // wendet tree auf alle Pixel an, die er mit labels nicht gesehen hat.
+    // Die Bäume werden parallel trainiert und auch parallel gezählt, nur das
+    // Addieren auf die gemeinsamen Bilder ist atomar.
+    template <typename T>
+    void add_tree(Tree<T>& tree, TrainingData& labels, LabeledImages& data)
     {
-        if(test_object != NULL) {
-            JSONArray node_array;
-            node_array.push_back(test_object->to_json());
-            node_array.push_back(left_child->to_json());
-            node_array.push_back(right_child->to_json());
-            return new JSONValue(node_array);
-        } else {
-            return leaf_info->to_json();
+        for(SelectedPixels pixel(labels); pixel.next(); ) {
+            if(pixel.label != 0) {
+                continue;
+            }
+            CImg<unsigned char>& image = *(data.training_images[pixel.image]);
+            float probability = static_cast<float>(tree.inference(image, pixel.x, pixel.y)->foreground_probability);
+            float& sum = (*probability_sums[pixel.image])(pixel.x, pixel.y);
+            unsigned short& count = (*votes[pixel.image])(pixel.x, pixel.y);
+#pragma omp atomic
+            sum += probability;
+#pragma omp atomic
+            count += 1;
+        }
+#pragma omp atomic
+        number_of_trees += 1;
+    }
+
+
+    // trägt die Konfusionsmatrix und das F-Maß in die Lernparameter ein.
+    // Ohne Pixel, die irgendein Baum nicht gesehen hat, passiert nichts.
+    void add_to_json(JSONObject& learning_parameters, LabeledImages& data) const
+    {
+        // zählt true-negative, false-negative, false-positive und
+        // true-positive (wie Forest::print_result_statistics), aber gewichtet
+        double count_right_and_wrong[4] = { 0.0, 0.0, 0.0, 0.0 };
+        unsigned long number_of_pixels = 0;
+        for(unsigned int i = 0; i < votes.size(); ++i) {
+            // pro Pixelklasse, wie viele Pixel nicht gesehen wurden und wie
+            // viele davon als Vordergrund herauskamen
+            unsigned long unseen[4] = { 0, 0, 0, 0 };
+            unsigned long positive[4] = { 0, 0, 0, 0 };
+            CImg<unsigned char>& classes = *(data.pixel_classes[i]);
+            cimg_forXY(classes, x, y) {
+                unsigned short n = (*votes[i])(x, y);
+                if(n == 0) {
+                    continue;
+                }
+                unsigned char c = classes(x, y);
+                unseen[c] += 1;
+                positive[c] += ((*probability_sums[i])(x, y) > 0.5f * n);
+                ++number_of_pixels;
+            }
+
+            double band = static_cast<double>(data.band_counts[i]);
+            double background = static_cast<double>(data.background_counts[i]);
+            if(unseen[PIXEL_BACKGROUND_BAND] == 0) {
+                background += band;
+                band = 0.0;
+            } else if(unseen[PIXEL_BACKGROUND] == 0) {
+                band += background;
+                background = 0.0;
+            }
+            const unsigned char pixel_class[3] = { PIXEL_FOREGROUND, PIXEL_BACKGROUND_BAND, PIXEL_BACKGROUND };
+            const double class_size[3] = { static_cast<double>(data.foreground_counts[i]), band, background };
+            for(unsigned int k = 0; k < 3; ++k) {
+                unsigned char c = pixel_class[k];
+                if(unseen[c] == 0) {
+                    continue;
+                }
+                double weight = class_size[k] / unseen[c];
+                bool ground_truth_is_foreground = (c == PIXEL_FOREGROUND);
+                count_right_and_wrong[2 + ground_truth_is_foreground] += weight * positive[c];
+                count_right_and_wrong[ground_truth_is_foreground] += weight * (unseen[c] - positive[c]);
+            }
+        }
+        if(number_of_pixels == 0) {
+            return;
         }
+
+        double f_measure = 1.0 / (1.0 + (count_right_and_wrong[2]+count_right_and_wrong[1]) / (2*count_right_and_wrong[3]));
+
+        JSONObject confusion_matrix;
+        confusion_matrix[L"True negatives"] = new JSONValue(count_right_and_wrong[0]);
+        confusion_matrix[L"False negatives"] = new JSONValue(count_right_and_wrong[1]);
+        confusion_matrix[L"False positives"] = new JSONValue(count_right_and_wrong[2]);
+        confusion_matrix[L"True positives"] = new JSONValue(count_right_and_wrong[3]);
+
+        learning_parameters[L"Out-of-bag fraction"] = new JSONValue(out_of_bag_fraction);
+        learning_parameters[L"Out-of-bag trees"] = new JSONValue(static_cast<double>(number_of_trees));
+        learning_parameters[L"Out-of-bag pixels"] = new JSONValue(static_cast<double>(number_of_pixels));
+        learning_parameters[L"Out-of-bag F-measure"] = new JSONValue(f_measure);
+        learning_parameters[L"Out-of-bag confusion matrix"] = new JSONValue(confusion_matrix);
+
+        std::cout << "Out-of-bag-F-Maß aus " << number_of_trees << " Bäumen: " << f_measure << std::endl;
     }
 
+private:
+    OutOfBagEstimate(const OutOfBagEstimate&);
+    OutOfBagEstimate& operator=(const OutOfBagEstimate&);
 };
 
 
 
-// sortiert die Liste im Intervall [from, to) so um, dass die Beispiele, die
-// vom gegebenen Testobjekt nach links klassifiziert werden alle vor den
-// anderen kommen. Gibt den Index mit der Grenze zurück, nämlich dem ersten von
-// den rechten Beispielen.
+// die Lernparameter, die am Anfang jeder JSON-Datei mit einem Wald stehen
+// (aus parameters, aber mit forest_size Bäumen). Wenn out_of_bag nicht NULL ist, kommt noch die Schätzung aus dem Training
+// dazu (dafür werden die Trainingsbilder in data gebraucht).
+template <typename T>
+JSONObject learning_parameters_json(const ForestParameters& parameters, unsigned long forest_size, const OutOfBagEstimate* out_of_bag, LabeledImages* data)
+{
+    JSONObject learning_parameters;
+    learning_parameters[L"Test Type"] = new JSONValue(T::name);
+    learning_parameters[L"Model type"] = new JSONValue(parameters.model_type == 1 ? L"Random ferns" : L"Decision trees");
+    learning_parameters[L"Max tree depth"] = new JSONValue(static_cast<double>(parameters.max_tree_depth));
+    learning_parameters[L"Testobject tries"] = new JSONValue(static_cast<double>(parameters.testobject_tries));
+    learning_parameters[L"Forest size"] = new JSONValue(static_cast<double>(forest_size));
+    learning_parameters[L"Window radius"] = new JSONValue(static_cast<double>(parameters.window_radius));
+    if(!parameters.offset_pool.empty()) {
+        offset_pool_to_json(learning_parameters, parameters.offset_pool);
+    }
+    tree_origin_to_json(learning_parameters, parameters);
+    if(out_of_bag != NULL) {
+        out_of_bag->add_to_json(learning_parameters, *data);
+    }
+    return learning_parameters;
+}
+
+
+
+// Zwischenstand beim Training: jeder fertige Baum wird sofort als eine Zeile
+// an diese Datei angehängt und kann dann aus dem Speicher gelöscht werden.
+// Die erste Zeile enthält die Lernparameter und die Labelfarben. Bricht das
+// Training ab, macht es mit resume() nach dem letzten geschriebenen Baum
+// weiter. Am Ende baut write_forest() daraus die normale JSON-Datei.
 template <typename T>
-unsigned int rearrange_samples(std::vector<unsigned int>& samples, unsigned int from, unsigned int to, T* testobject, TrainingData& training)
+class TreeCheckpoint
 {
-    unsigned int left = from;
-    unsigned int right = to;
+public:
+    std::string filename;
+    std::wofstream out;
+    unsigned short number_of_trees;
+
+    // die Parameter des Walds, der trainiert wird. Sie stehen im Kopf, und
+    // beim Fortsetzen wird der Offset-Pool aus dem Kopf übernommen.
+    ForestParameters* parameters;
+
+
+    TreeCheckpoint(std::string filename, ForestParameters& parameters)
+    {
+        this->filename = filename;
+        this->number_of_trees = 0;
+        this->parameters = &parameters;
+    }
+
+
+    // fängt einen neuen Zwischenstand an (ein alter wird überschrieben)
+    void start(unsigned char background_color, unsigned char foreground_color)
+    {
+        if(out.is_open()) {
+            out.close();
+        }
+        out.open(filename.c_str(), std::ios::out | std::ios::trunc);
+        if(!out) {
+            std::cerr << "Fehler: " << filename << " konnte nicht geschrieben werden" << std::endl;
+            std::exit(1);
+        }
+
+        JSONArray header;
+        header.push_back(new JSONValue(learning_parameters_json<T>(*parameters, 0, NULL, NULL)));
+        header.push_back(new JSONValue(static_cast<double>(background_color)));
+        header.push_back(new JSONValue(static_cast<double>(foreground_color)));
+        JSONValue* header_value = new JSONValue(header);
+        out << header_value->Stringify(false) << std::endl;
+        delete header_value;
+
+        number_of_trees = 0;
+    }
+
+
+    // liest einen vorhandenen Zwischenstand ein. Gibt false zurück, wenn es
+    // keinen gibt.
+    bool resume(unsigned char background_color, unsigned char foreground_color)
+    {
+        std::wifstream in(filename.c_str());
+        std::wstring line;
+        if(!in || !std::getline(in, line)) {
+            return false;
+        }
+        JSONValue* header_value = JSON::Parse(line.c_str());
+        if(header_value == NULL) {
+            return false;
+        }
 
-    do {
-        while(testobject->goes_left(training.training_images[samples[left]], samples[left+1], samples[left+2])) {
-            left += 3;
+        JSONArray header = header_value->AsArray();
+        JSONObject learning_parameters = header.at(0)->AsObject();
+
+        // die Bäume im Zwischenstand haben ihre Offsets aus dem Pool im Kopf,
+        // also wird mit diesem weitertrainiert
+        size_t drawn_pool_size = parameters->offset_pool.size();
+        offset_pool_from_json(learning_parameters, parameters->offset_pool);
+
+        // genauso mit der Herkunft: ohne sie im Kopf (nach einem Warmstart
+        // mit einem fremden Wald) hat auch der fertige Wald keine, sonst
+        // müssen Startwert und erster Index stimmen
+        ForestParameters header_origin;
+        tree_origin_from_json(learning_parameters, header_origin);
+        bool same_origin = (!header_origin.has_tree_origin ||
+                (header_origin.random_seed == parameters->random_seed && header_origin.first_tree_index == parameters->first_tree_index));
+        parameters->has_tree_origin = parameters->has_tree_origin && header_origin.has_tree_origin;
+
+        bool compatible = (learning_parameters[L"Test Type"]->AsString() == T::name &&
+                parameters->offset_pool.size() == drawn_pool_size && same_origin &&
+                static_cast<unsigned int>(learning_parameters[L"Window radius"]->AsNumber()) == parameters->window_radius &&
+                static_cast<unsigned int>(learning_parameters[L"Max tree depth"]->AsNumber()) == parameters->max_tree_depth &&
+                static_cast<unsigned int>(learning_parameters[L"Testobject tries"]->AsNumber()) == parameters->testobject_tries &&
+                static_cast<unsigned char>(header.at(1)->AsNumber()) == background_color &&
+                static_cast<unsigned char>(header.at(2)->AsNumber()) == foreground_color);
+        delete header_value;
+        if(!compatible) {
+            std::cerr << "Fehler: Der Zwischenstand in " << filename << " wurde mit anderen Parametern oder Labelfarben trainiert" << std::endl;
+            std::exit(1);
         }
 
-        while(!testobject->goes_left(training.training_images[samples[right]], samples[right+1], samples[right+2])) {
-            right -= 3;
+        // die letzte Zeile kann unvollständig sein, wenn das Training beim
+        // Schreiben abgebrochen wurde. Sie wird weggelassen und der
+        // Zwischenstand ohne sie neu geschrieben.
+        std::vector<std::wstring> tree_lines;
+        while(std::getline(in, line)) {
+            JSONValue* tree_value = JSON::Parse(line.c_str());
+            if(tree_value == NULL) {
+                break;
+            }
+            delete tree_value;
+            tree_lines.push_back(line);
         }
+        in.close();
 
-        if(left >= right) {
-            return left;
+        start(background_color, foreground_color);
+        for(size_t i = 0; i < tree_lines.size(); ++i) {
+            out << tree_lines[i] << '\n';
         }
+        out.flush();
+        number_of_trees = static_cast<unsigned short>(tree_lines.size());
 
-        std::swap(samples[left], samples[right]);
-        std::swap(samples[left+1], samples[right+1]);
-        std::swap(samples[left+2], samples[right+2]);
-        left += 3;
-        right -= 3;
+        std::cout << "Setze das Training nach " << number_of_trees << " Bäumen fort" << std::endl;
+        return true;
+    }
 
-    } while(true);
 
-    return left;
-}
+    void append(Tree<T>* tree)
+    {
+        JSONValue* tree_value = tree->to_json();
+        out << tree_value->Stringify(false) << std::endl;
+        delete tree_value;
+        number_of_trees += 1;
+    }
 
 
+    // schreibt alle Bäume aus dem Zwischenstand als Wald in die Datei
+    // target_filename (im selben Format wie Forest::write_to_file) und löscht
+    // den Zwischenstand. Die Bäume werden dabei einzeln durchgereicht, es ist
+    // also nie der ganze Wald im Speicher. Die Schätzung out_of_bag (kann
+    // NULL sein) kommt zu den Lernparametern dazu.
+    void write_forest(std::string target_filename, const OutOfBagEstimate* out_of_bag, LabeledImages* data)
+    {
+        out.close();
 
-template <typename T>
-class Tree
+        std::wifstream in(filename.c_str());
+        std::wstring line;
+        std::getline(in, line);
+        JSONValue* header_value = JSON::Parse(line.c_str());
+        JSONArray header = header_value->AsArray();
+
+        JSONValue learning_parameters(learning_parameters_json<T>(*parameters, number_of_trees, out_of_bag, data));
+
+        std::wofstream result(target_filename.c_str());
+        result << '[' << learning_parameters.Stringify(false);
+        result << ',' << header.at(1)->Stringify(false) << ',' << header.at(2)->Stringify(false);
+        for(unsigned short i = 0; i < number_of_trees && std::getline(in, line); ++i) {
+            result << ',' << line;
+        }
+        result << "]\n";
+        delete header_value;
+
+        in.close();
+        result.close();
+        if(!result) {
+            std::cerr << "Fehler: " << target_filename << " konnte nicht geschrieben werden" << std::endl;
+            std::exit(1);
+        }
+        std::remove(filename.c_str());
+    }
+};
+
+
+
+// Eine Inferenz mit einem Wald: ihre Parameter und was sie sich
+// zwischendurch merkt. Der Wald selbst wird bei der Inferenz nur gelesen.
+// Mehrere Inferenzen (auch mit demselben Wald) können also gleichzeitig in
+// verschiedenen Threads laufen, solange jede ihr eigenes
+// InferenceRequest-Objekt hat.
+class InferenceRequest
 {
 
 public:
+    // das Kantengewicht bei Maxflow und exp(-pairwise_energy) als Faktor
+    // beim Gibbs-Sampling
+    double pairwise_energy;
+    double pairwise_factor;
 
-    Node<T>* root;
+    unsigned int gibbs_sampling_steps;
 
+    // Zustand des Zufallsgenerators für das Gibbs-Sampling (für erand48 und
+    // nrand48). Er fängt da an, wo drand48 ohne srand48 anfangen würde.
+    unsigned short random_state[3];
 
-    static Tree* train(TrainingData& labels)
+    // mit Offset-Pool die Differenzen aller Paare in der Zeile pool_row von
+    // pool_image, eine Bildzeile pro Paar (siehe
+    // Forest::compute_pool_differences)
+    std::vector<short> pool_differences;
+    const CImg<unsigned char>* pool_image;
+    int pool_row;
+
+
+    InferenceRequest(double pairwise_energy, unsigned int gibbs_sampling_steps)
     {
-        Tree<T>* tree = new Tree;
+        this->pairwise_energy = pairwise_energy;
+        this->pairwise_factor = exp(-pairwise_energy);
+        this->gibbs_sampling_steps = gibbs_sampling_steps;
+        random_state[0] = 0x330e;
+        random_state[1] = 0xabcd;
+        random_state[2] = 0x1234;
+        pool_image = NULL;
+        pool_row = -1;
+    }
+};
 
 
-        // eine Liste der Form [i1, x1, y1, i2, x2, y2, ...] mit Bildindex und
-        // den Koordinaten aller Pixel im Trainingsbild, die für das Training
-        // benutzt werden.
-        std::vector<unsigned int> samples(3 * labels.number_of_labeled_pixels);
-        unsigned int samples_count = 0;
-        for(unsigned int i = 0; i < labels.label_masks.size(); ++i) {
-            cimg_for_insideXY(*(labels.label_masks[i]), x, y, WINDOW_RADIUS) {
-                if((*(labels.label_masks[i]))(x, y) > 0) {
-                    samples[samples_count] = i;
-                    samples[samples_count + 1] = x;
-                    samples[samples_count + 2] = y;
-                    samples_count += 3;
-                }
-            }
-        }
-        samples_count -= 3;
 
+template <typename T>
+class Forest
+{
+public:
+    std::vector<Tree<T>*> trees;
 
-        // Wurzelknoten bauen, und zwar mit allen Samples aus der Liste
-        LearningState<T> root_state;
-        root_state.depth = 1;
-        root_state.from = 0;
-        root_state.to = samples_count;
-        tree->root = Node<T>::build_inner_node(labels, root_state, samples);
+    // bei model_type 1 stehen hier die Farne, und trees ist leer
+    std::vector<Fern<T>*> ferns;
+
+    unsigned char background_color;
+    unsigned char foreground_color;
+
+    // mit diesen Parametern wurde bzw. wird der Wald trainiert
+    ForestParameters parameters;
+
+    // wenn true, haben alle Testobjekte ihre Offsets aus dem Offset-Pool,
+    // und inference() nimmt die Differenzen aus
+    // InferenceRequest::pool_differences
+    bool use_offset_pool;
+
+
+    Forest()
+    {
+        use_offset_pool = false;
+    }
+
+
+    static Forest<T> train(LabeledImages& data, const ForestParameters& parameters, const TrainingSettings& settings) {
+
+        Forest forest;
 
-        // die Liste so umsortieren, dass alle Pixel, die der Wurzelknoten nach
-        // links schickt auch links in der Liste sitzen
-        root_state.border = rearrange_samples(samples, root_state.from, root_state.to, tree->root->test_object, labels);
+        forest.background_color = data.background_color;
+        forest.foreground_color = data.foreground_color;
+        forest.parameters = parameters;
 
+        forest.train_trees(data, parameters.forest_size, settings, NULL, NULL);
 
-        // hier sind die Knoten drin, die schon ein Testobjekt haben, aber noch
-        // keine Kindknoten
-        std::deque<LearningState<T> > pending_nodes;
-        LearningState<T> start_state;
-        start_state.node = tree->root;
-        start_state.depth = 1;
-        start_state.from = 0;
-        start_state.to = samples_count;
-        start_state.border = root_state.border;
+        return forest;
+    }
 
-        pending_nodes.push_back(start_state);
 
-        while(!pending_nodes.empty()) {
-            LearningState<T> current_pending_node = pending_nodes.back();
-            pending_nodes.pop_back();
+    // trainiert so viele neue Bäume, bis der Wald target_size Bäume hat.
+    // Damit kann man auch einen schon trainierten (z.B. mit load_from_file
+    // geladenen) Wald vergrößern. Ist checkpoint nicht NULL, wird jeder
+    // fertige Baum gleich dort angehängt und wieder gelöscht, statt ihn in
+    // trees zu sammeln. Die Bäume im Zwischenstand zählen dann mit. Ist
+    // out_of_bag nicht NULL, wird jeder neue Baum dort gezählt.
+    //
+    // Mit Zeitbudget (settings.time_budget) fangen alle Threads sofort mit
+    // ihren Bäumen an. Nach jedem fertigen Baum wird die mittlere Dauer pro
+    // Testobjekt-Versuch aktualisiert und geplant, wie viele Versuche die
+    // noch nicht angefangenen Bäume machen können (siehe
+    // plan_testobject_tries). Ein neuer Baum wird nur angefangen, wenn er
+    // voraussichtlich noch rechtzeitig fertig wird. Die Bäume selbst prüfen
+    // bei jedem Knoten, ob die Zeit um ist (siehe past_deadline), und hören
+    // dann mit Blättern auf. Da jeder fertige Baum gleich im Zwischenstand
+    // landet, gibt es zu jedem Zeitpunkt einen gültigen Wald.
+    void train_trees(LabeledImages& data, unsigned short target_size, const TrainingSettings& settings, TreeCheckpoint<T>* checkpoint, OutOfBagEstimate* out_of_bag) {
+
+        short first_tree = static_cast<short>(trees.size() + (checkpoint != NULL ? checkpoint->number_of_trees : 0));
+
+        TrainingSettings tree_settings = settings;
+        if(settings.time_budget > 0.0) {
+            tree_settings.deadline = wall_time() + settings.time_budget;
+        }
 
-            // prüfen, ob links nicht schon ein Blattknoten ist (z.B. weil die
-            // maximale Tiefe erreicht wurde)
-            if(current_pending_node.node->left_child == NULL) {
-                LearningState<T> left_state = current_pending_node; // kopieren
-                left_state.depth += 1;
-                // der zukünftige linke Kindknoten soll nur die Trainingspixel
-                // verwenden, die current_pending_node.node nach links schickt
-                left_state.to = left_state.border - 3;
-                Node<T>* new_node = Node<T>::build_inner_node(labels, left_state, samples);
-                left_state.border = rearrange_samples(samples, left_state.from, left_state.to, new_node->test_object, labels);
-                left_state.node->left_child = new_node;
-                left_state.node = new_node;
-                pending_nodes.push_back(left_state);
+        // Buchführung für das Zeitbudget, nur im kritischen Abschnitt
+        // time_budget verwendet
+        const unsigned int requested_tries = parameters.testobject_tries;
+        unsigned int planned_tries = requested_tries;
+        unsigned int fewest_tries = requested_tries;
+        double seconds_per_try = 0.0;
+        unsigned int finished_trees = 0;
+        unsigned int started_trees = 0;
+        bool out_of_time = false;
+
+        // beim ebenenweisen Training (auch als Dschungel) werden die Threads
+        // innerhalb eines Baums verwendet, dann werden die Bäume
+        // nacheinander trainiert
+#pragma omp parallel for schedule(dynamic) num_threads(training_threads(settings)) if(settings.growth_mode != 1 && settings.growth_mode != 3)
+        for(short i = first_tree; i < target_size; ++i) {
+
+            // jeder Baum bekommt seine eigene Kopie der Parameter, weil die
+            // Versuche sich mit dem Zeitbudget ändern können
+            ForestParameters tree_parameters = parameters;
+
+            // aus einer parallelen Schleife kann man nicht einfach
+            // herausspringen, deshalb werden die restlichen Bäume übersprungen
+            if(settings.time_budget > 0.0) {
+                bool skip;
+#pragma omp critical(time_budget)
+                {
+                    if(!out_of_time && (past_deadline(tree_settings) || (finished_trees > 0 && wall_time() + seconds_per_try * planned_tries > tree_settings.deadline))) {
+                        out_of_time = true;
+                    }
+                    skip = out_of_time;
+                    if(!skip) {
+                        tree_parameters.testobject_tries = planned_tries;
+                        fewest_tries = std::min(fewest_tries, planned_tries);
+                        started_trees += 1;
+                    }
+                }
+                if(skip) {
+                    continue;
+                }
             }
 
-            if(current_pending_node.node->right_child == NULL) {
-                LearningState<T> right_state = current_pending_node;
-                right_state.depth += 1;
-                right_state.from = right_state.border;
-                Node<T>* new_node = Node<T>::build_inner_node(labels, right_state, samples);
-                right_state.border = rearrange_samples(samples, right_state.from, right_state.to, new_node->test_object, labels);
-                right_state.node->right_child = new_node;
-                right_state.node = new_node;
-                pending_nodes.push_back(right_state);
+            double tree_start_time = wall_time();
+            train_tree(data, i, target_size, tree_parameters, tree_settings, checkpoint, out_of_bag);
+
+            // die Schätzung mit der tatsächlichen Dauer verbessern
+            if(settings.time_budget > 0.0) {
+                double tree_seconds = wall_time() - tree_start_time;
+#pragma omp critical(time_budget)
+                {
+                    finished_trees += 1;
+                    seconds_per_try += (tree_seconds / tree_parameters.testobject_tries - seconds_per_try) / finished_trees;
+                    unsigned int remaining_trees = target_size - first_tree - started_trees;
+                    unsigned int tries = plan_testobject_tries(seconds_per_try, tree_settings.deadline - wall_time(), remaining_trees, settings, requested_tries);
+                    if(tries != planned_tries && remaining_trees > 0) {
+#pragma omp critical(output)
+                        std::cout << "Für das Zeitbudget werden jetzt " << tries << " statt " << requested_tries << " Testobjekte pro Knoten versucht" << std::endl;
+                    }
+                    planned_tries = tries;
+                }
             }
         }
 
-        return tree;
-    }
-
+        // im Wald steht, wieviele Versuche höchstens für alle Bäume gereicht
+        // haben
+        parameters.testobject_tries = fewest_tries;
 
-    ~Tree() {
-        delete this->root;
+        if(out_of_time || past_deadline(tree_settings)) {
+            std::cout << "Das Zeitbudget ist aufgebraucht" << std::endl;
+        }
     }
 
 
-    static Tree* from_json(JSONValue* json_value)
-    {
-        Tree<T>* tree = new Tree;
-        tree->root = Node<T>::from_json(json_value);
-        return tree;
-    }
+    // trainiert den Baum mit dem Index i (mit tree_parameters statt
+    // parameters) und hängt ihn an
+    void train_tree(LabeledImages& data, short i, unsigned short target_size, const ForestParameters& tree_parameters, const TrainingSettings& settings, TreeCheckpoint<T>* checkpoint, OutOfBagEstimate* out_of_bag) {
+
+        // Die Konsolenausgabe ist nicht threadsicher, deshalb ist das ein
+        // kritischer Abschnitt, d.h. solange ein Thread diese Codezeile
+        // ausführt, darf die kein anderer auch ausführen. Andererseits kann
+        // es auch lustig aussehen, wenn die Ausgabe durcheinandergerät.
+#pragma omp critical(output)
+        std::cout << "Trainiere Baum " << i+1 << " von " << target_size << std::endl;
+
+        // man muss für jeden Baum ein neues TrainingData-Objekt erstellen,
+        // damit die Hintergrundpixel, die für das Training verwendet werden,
+        // bei jedem Baum neu ausgewürfelt werden. Die Trainingsbilder selbst
+        // teilen sich alle Bäume.
+        TrainingData labels(data, tree_parameters, settings, settings.first_tree_index + i);
+
+        Tree<T>* t;
+        if(settings.growth_mode == 1) {
+            t = Tree<T>::train_levelwise(labels);
+        } else if(settings.growth_mode == 2) {
+            t = Tree<T>::train_bestfirst(labels);
+        } else if(settings.growth_mode == 3) {
+            t = Tree<T>::train_jungle(labels);
+        } else {
+            t = Tree<T>::train(labels);
+        }
 
+        if(out_of_bag != NULL) {
+            out_of_bag->add_tree(*t, labels, data);
+        }
 
-    JSONValue* to_json()
-    {
-        return this->root->to_json();
+        // da die STL nicht threadsicher ist, ist das Hinzufügen zu einem
+        // Vektor (oder zum Zwischenstand) auch ein kritischer Abschnitt
+#pragma omp critical(append_to_list)
+        {
+            if(checkpoint != NULL) {
+                checkpoint->append(t);
+                delete t;
+            } else {
+                this->trees.push_back(t);
+            }
+        }
     }
 
 
-    LeafInfo* inference(CImg<unsigned char>& image, unsigned int x, unsigned int y)
+    // wieviele Testobjekte pro Knoten die übrigen remaining_trees Bäume
+    // versuchen können, damit sie in remaining_seconds fertig werden, wenn
+    // ein Baum (der wie in settings wächst) pro Versuch im Mittel
+    // seconds_per_try dauert. Es werden nie mehr als requested_tries und nie
+    // weniger als requested_tries / MIN_TRIES_DIVISOR.
+    unsigned int plan_testobject_tries(double seconds_per_try, double remaining_seconds, unsigned int remaining_trees, const TrainingSettings& settings, unsigned int requested_tries)
     {
-        Node<T>* current_node = this->root;
-        while(current_node->test_object != NULL) {
-            if(current_node->test_object->goes_left(&image, x, y))
-                current_node = current_node->left_child;
-            else
-                current_node = current_node->right_child;
+        if(remaining_trees == 0 || seconds_per_try <= 0.0) {
+            return requested_tries;
         }
 
-        return current_node->leaf_info;
-    }
-};
+        // so viele Bäume werden gleichzeitig trainiert
+        unsigned int parallel_trees = 1;
+        if(settings.growth_mode != 1 && settings.growth_mode != 3) {
+            parallel_trees = training_threads(settings);
+        }
+        unsigned int rounds = (remaining_trees + parallel_trees - 1) / parallel_trees;
+        double seconds_available = std::max(remaining_seconds, 0.0) / rounds;
 
+        unsigned int min_tries = std::max(requested_tries / MIN_TRIES_DIVISOR, 1u);
+        double tries = seconds_available / seconds_per_try;
+        if(tries >= requested_tries) {
+            return requested_tries;
+        }
+        return std::max(static_cast<unsigned int>(tries), min_tries);
+    }
 
 
+    // trainiert parameters.forest_size Farne. Jeder bekommt wie ein Baum
+    // seine eigene Auswahl von Hintergrundpixeln.
+    void train_ferns(LabeledImages& data, const TrainingSettings& settings) {
 
+#pragma omp parallel for num_threads(training_threads(settings))
+        for(short i = 0; i < parameters.forest_size; ++i) {
 
+#pragma omp critical(output)
+            std::cout << "Trainiere Farn " << i+1 << " von " << parameters.forest_size << std::endl;
 
+            TrainingData labels(data, parameters, settings, settings.first_tree_index + i);
+            Fern<T>* fern = Fern<T>::train(labels);
 
+#pragma omp critical(append_to_list)
+            this->ferns.push_back(fern);
+        }
+    }
 
 
-template <typename T>
-class Forest
-{
-public:
-    std::vector<Tree<T>*> trees;
-    unsigned char background_color;
-    unsigned char foreground_color;
+    // passt die Blätter aller Bäume an neue Labelbilder an, ohne die Bäume
+    // neu zu lernen (siehe Tree::refit). Das dauert etwa so lange wie eine
+    // Inferenz auf den Trainingsbildern.
+    void refit(LabeledImages& data, bool keep_counts, unsigned int number_of_threads) {
+
+        // beim Nachtrainieren werden alle Vordergrundpixel gezählt, also ohne
+        // Out-of-bag-Anteil
+        TrainingSettings settings;
+        settings.number_of_threads = number_of_threads;
+
+        // ist bekannt, woher die Bäume kommen, bekommt jeder dieselbe
+        // Auswahl von Hintergrundpixeln wie beim Training, solange die Bäume nach ihrem Index
+        // sortiert in der Datei stehen (z.B. nach einem Training mit einem
+        // Thread). Mit denselben Bildern werden dann genau die Anzahlen aus
+        // dem Training gezählt.
+        if(parameters.has_tree_origin) {
+            settings.random_seed = parameters.random_seed;
+            settings.first_tree_index = parameters.first_tree_index;
+        }
 
+#pragma omp parallel for num_threads(training_threads(settings))
+        for(long i = 0; i < static_cast<long>(trees.size()); ++i) {
 
-    static Forest<T> train(std::vector<std::string> training_image_filenames, std::vector<std::string> label_filenames) {
+#pragma omp critical(output)
+            std::cout << "Passe Baum " << i+1 << " von " << trees.size() << " an" << std::endl;
 
-        Forest forest;
+            // wie beim Training bekommt jeder Baum seine eigene Auswahl von
+            // Hintergrundpixeln, damit die Wahrscheinlichkeiten in den
+            // Blättern zu denen aus dem Training passen
+            TrainingData labels(data, parameters, settings, settings.first_tree_index + i);
+            trees[i]->refit(labels, keep_counts);
+        }
 
-#pragma omp parallel for
-        for(short i = 0; i < FOREST_SIZE; ++i) {
+#pragma omp parallel for num_threads(training_threads(settings))
+        for(long i = 0; i < static_cast<long>(ferns.size()); ++i) {
 
-            // Die Konsolenausgabe ist nicht threadsicher, deshalb ist das ein
-            // kritischer Abschnitt, d.h. solange ein Thread diese Codezeile
-            // ausführt, darf die kein anderer auch ausführen. Andererseits
-            // kann es auch lustig aussehen, wenn die Ausgabe
-            // durcheinandergerät.
 #pragma omp critical(output)
-            std::cout << "Trainiere Baum " << i+1 << " von " << FOREST_SIZE << std::endl;
+            std::cout << "Passe Farn " << i+1 << " von " << ferns.size() << " an" << std::endl;
 
-            // man muss für jeden Baum ein neues TrainingData-Objekt erstellen,
-            // damit die Hintergrundpixel, die für das Training verwendet
-            // werden, bei jedem Baum neu ausgewürfelt werden
-            //
-            // TODO: andere Lösung überlegen, das braucht bei mehreren Threads
-            // unnötig Speicher, weil das Objekt auch die Trainingsbilder
-            // enthält, die aber immer gleich sind
-            TrainingData labels(training_image_filenames, label_filenames);
-
-            Tree<T>* t = Tree<T>::train(labels);
-
-            // da die STL nicht threadsicher ist, ist das Hinzufügen zu einem
-            // Vektor auch ein kritischer Abschnitt
-#pragma omp critical(append_to_list)
-            forest.trees.push_back(t);
+            TrainingData labels(data, parameters, settings, settings.first_tree_index + i);
+            ferns[i]->refit(labels, keep_counts);
         }
+    }
 
-        TrainingData labels(training_image_filenames, label_filenames); // nochmal so ein Objekt erstellen, um an die Vordergrund- und Hintergrundfarben zu kommen. TODO: was eleganteres überlegen
-        forest.background_color = labels.background_color;
-        forest.foreground_color = labels.foreground_color;
 
-        return forest;
+    // schneidet alle Bäume auf die Tiefe max_depth ab. Das ergibt (bis auf
+    // die Zufallszahlen) denselben Wald, als wäre er gleich mit dieser Tiefe
+    // trainiert worden. Kann ein Baum nicht abgeschnitten werden, bleibt der
+    // ganze Wald unverändert und es wird false zurückgegeben.
+    bool truncate(unsigned short max_depth) {
+        for(size_t i = 0; i < trees.size(); ++i) {
+            if(!trees[i]->can_truncate(max_depth)) {
+                return false;
+            }
+        }
+        for(size_t i = 0; i < trees.size(); ++i) {
+            trees[i]->truncate(max_depth);
+        }
+        return true;
     }
 
 
@@ -902,38 +5133,93 @@ public:
         for(size_t i = 0; i < trees.size(); ++i) {
             delete trees[i];
         }
+        for(size_t i = 0; i < ferns.size(); ++i) {
+            delete ferns[i];
+        }
     }
 
 
     // gibt für ein Pixel die Wahrscheinlichkeit zurück, dass es sich um ein
     // Vordergrundpixel handelt
-    double inference(CImg<unsigned char>& image, unsigned int x, unsigned int y) {
+    double inference(CImg<unsigned char>& image, unsigned int x, unsigned int y, InferenceRequest& request) {
+        const short* differences = NULL;
+        if(use_offset_pool) {
+            // die Pixel werden zeilenweise abgefragt, also werden die
+            // Differenzen für eine ganze Zeile auf einmal berechnet
+            if(request.pool_image != &image || request.pool_row != static_cast<int>(y)) {
+                compute_pool_differences(image, y, request);
+            }
+            differences = &request.pool_differences[x];
+        }
+        if(!ferns.empty()) {
+            return fern_inference(image, x, y, differences);
+        }
+
         double sum_foreground_probability = 0.0;
-        for(unsigned int i = 0; i < FOREST_SIZE; ++i) {
-            LeafInfo* leaf = this->trees[i]->inference(image, x, y);
+        for(unsigned int i = 0; i < parameters.forest_size; ++i) {
+            LeafInfo* leaf = differences != NULL ? this->trees[i]->inference(differences, image.width()) : this->trees[i]->inference(image, x, y);
             sum_foreground_probability += leaf->foreground_probability;
         }
-        return sum_foreground_probability / FOREST_SIZE;
+        return sum_foreground_probability / parameters.forest_size;
+    }
+
+
+    // Farne werden nicht gemittelt, sondern wie in einem naiven
+    // Bayes-Klassifikator kombiniert, d.h. ihre Log-Odds werden addiert. Der
+    // Mittelwert wäre bei vielen schwachen Farnen so unscharf, dass Maxflow
+    // dünne Linien wegglätten würde.
+    double fern_inference(CImg<unsigned char>& image, unsigned int x, unsigned int y, const short* differences) {
+        double log_odds = 0.0;
+        for(unsigned int i = 0; i < parameters.forest_size; ++i) {
+            Fern<T>& fern = *(this->ferns[i]);
+            log_odds += fern.log_odds[differences != NULL ? fern.index(differences, image.width()) : fern.index(image, x, y)];
+        }
+        return 1.0 / (1.0 + exp(-log_odds));
+    }
+
+
+    // berechnet für jedes Paar aus dem Offset-Pool die Differenzen in der
+    // Bildzeile y (ohne die Pixel am Rand) und merkt sie sich in request.
+    // Das sind nur Subtraktionen von zusammenhängenden Speicherbereichen,
+    // die der Compiler vektorisieren kann.
+    void compute_pool_differences(CImg<unsigned char>& image, unsigned int y, InferenceRequest& request)
+    {
+        const std::vector<short>& offset_pool = parameters.offset_pool;
+        const int radius = parameters.window_radius;
+        int width = image.width();
+        int inside_width = width - 2*radius;
+        request.pool_differences.resize(offset_pool.size() / 4 * width);
+        for(size_t k = 0; k < offset_pool.size() / 4; ++k) {
+            const unsigned char* pixel1 = image.data(radius + offset_pool[4*k], y + offset_pool[4*k + 1]);
+            const unsigned char* pixel2 = image.data(radius + offset_pool[4*k + 2], y + offset_pool[4*k + 3]);
+            short* differences = &request.pool_differences[k * width + radius];
+            for(int i = 0; i < inside_width; ++i) {
+                differences[i] = pixel1[i] - pixel2[i];
+            }
+        }
+        request.pool_image = &image;
+        request.pool_row = y;
     }
 
 
     // Inferenz mit dem Maxflow-Algorithmus. Der Quelltext befindet sich in 3rd_party/maxflow-v3.04.src/
-    CImg<unsigned char>* inference_maxflow(CImg<unsigned char>& image, const char* intermediate_result)
+    CImg<unsigned char>* inference_maxflow(CImg<unsigned char>& image, const char* intermediate_result, InferenceRequest& request)
     {
         typedef Graph_mf<double, double, double> GraphType;
+        const int radius = parameters.window_radius;
 
         // die Variablen im Graph sind alle Pixel außer die am Rand, weil für
         // die keine Ausgabe aus dem Random Forest als Unary Potential zur
         // Verfügung steht
-        int grid_width = image.width() - 2*WINDOW_RADIUS;
-        int grid_height = image.height() - 2*WINDOW_RADIUS;
+        int grid_width = image.width() - 2*radius;
+        int grid_height = image.height() - 2*radius;
         GraphType* graph = new GraphType(grid_width*grid_height, 2*grid_width*grid_height - grid_width - grid_height);
 
         CImg<unsigned char>* result = new CImg<unsigned char>(image.width(), image.height(), 1, 1, 0);
         int node_index = 0;
-        cimg_for_insideXY(image, x, y, WINDOW_RADIUS) {
+        cimg_for_insideXY(image, x, y, radius) {
 
-            double foreground_probability = inference(image, x, y);
+            double foreground_probability = inference(image, x, y, request);
 
             // Wahrscheinlichkeiten nahe bei 0 oder 1 sind erstens
             // unrealistisch und zweitens wird die Berechnung instabil
@@ -960,17 +5246,17 @@ public:
         // Energien zwischen Variablen (also zwischen benachbarten Pixeln) angeben
         for(int i = 0; i < grid_width*grid_height; ++i) {
             if((i + 1) % grid_width != 0) {  // alle Knoten außer die am rechten Rand
-                graph->add_edge(i, i+1, PAIRWISE_ENERGY, PAIRWISE_ENERGY);
+                graph->add_edge(i, i+1, request.pairwise_energy, request.pairwise_energy);
             }
             if(i < grid_width*(grid_height-1)) {  // alle Knoten außer die am unteren Rand
-                graph->add_edge(i, i+grid_width, PAIRWISE_ENERGY, PAIRWISE_ENERGY);
+                graph->add_edge(i, i+grid_width, request.pairwise_energy, request.pairwise_energy);
             }
         }
 
         graph->maxflow();
 
         node_index = 0;
-        cimg_for_insideXY(*result, x, y, WINDOW_RADIUS) {
+        cimg_for_insideXY(*result, x, y, radius) {
             (*result)(x, y) = graph->what_segment(node_index) == GraphType::SOURCE ? this->background_color : this->foreground_color;
             ++node_index;
         }
@@ -981,20 +5267,20 @@ public:
     }
 
 
-    unsigned char sample_corner_variable(unsigned char neighbor1_state, unsigned char neighbor2_state, float unary_pot) {
+    unsigned char sample_corner_variable(unsigned char neighbor1_state, unsigned char neighbor2_state, float unary_pot, InferenceRequest& request) {
         // Produkt aller Faktoren, wenn der Zustand der betrachteten Variablen 0 ist
         double a = unary_pot;
         if(neighbor1_state)
-            a *= PAIRWISE_FACTOR;
+            a *= request.pairwise_factor;
         if(neighbor2_state)
-            a *= PAIRWISE_FACTOR;
+            a *= request.pairwise_factor;
 
         // analog für 1
         double b = (1.0 - unary_pot);
         if(!neighbor1_state)
-            b *= PAIRWISE_FACTOR;
+            b *= request.pairwise_factor;
         if(!neighbor2_state)
-            b *= PAIRWISE_FACTOR;
+            b *= request.pairwise_factor;
 
         // normalisieren
         a = a/(a+b);
@@ -1003,76 +5289,77 @@ public:
 #ifdef _WIN32
         return (double) rand() / (double) RAND_MAX > a;
 #else
-        return drand48() > a;
+        return erand48(request.random_state) > a;
 #endif
     }
 
-    unsigned char sample_edge_variable(unsigned char neighbor1_state, unsigned char neighbor2_state, unsigned char neighbor3_state, float unary_pot) {
+    unsigned char sample_edge_variable(unsigned char neighbor1_state, unsigned char neighbor2_state, unsigned char neighbor3_state, float unary_pot, InferenceRequest& request) {
         double a = unary_pot;
         if(neighbor1_state)
-            a *= PAIRWISE_FACTOR;
+            a *= request.pairwise_factor;
         if(neighbor2_state)
-            a *= PAIRWISE_FACTOR;
+            a *= request.pairwise_factor;
         if(neighbor3_state)
-            a *= PAIRWISE_FACTOR;
+            a *= request.pairwise_factor;
 
         double b = (1.0 - unary_pot);
         if(!neighbor1_state)
-            b *= PAIRWISE_FACTOR;
+            b *= request.pairwise_factor;
         if(!neighbor2_state)
-            b *= PAIRWISE_FACTOR;
+            b *= request.pairwise_factor;
         if(!neighbor3_state)
-            b *= PAIRWISE_FACTOR;
+            b *= request.pairwise_factor;
 
         a = a/(a+b);
 
 #ifdef _WIN32
         return (double) rand() / (double) RAND_MAX > a;
 #else
-        return drand48() > a;
+        return erand48(request.random_state) > a;
 #endif
     }
 
-    unsigned char sample_inner_variable(unsigned char neighbor1_state, unsigned char neighbor2_state, unsigned char neighbor3_state, unsigned char neighbor4_state, float unary_pot) {
+    unsigned char sample_inner_variable(unsigned char neighbor1_state, unsigned char neighbor2_state, unsigned char neighbor3_state, unsigned char neighbor4_state, float unary_pot, InferenceRequest& request) {
         double a = unary_pot;
         if(neighbor1_state)
-            a *= PAIRWISE_FACTOR;
+            a *= request.pairwise_factor;
         if(neighbor2_state)
-            a *= PAIRWISE_FACTOR;
+            a *= request.pairwise_factor;
         if(neighbor3_state)
-            a *= PAIRWISE_FACTOR;
+            a *= request.pairwise_factor;
         if(neighbor4_state)
-            a *= PAIRWISE_FACTOR;
+            a *= request.pairwise_factor;
 
         double b = (1.0 - unary_pot);
         if(!neighbor1_state)
-            b *= PAIRWISE_FACTOR;
+            b *= request.pairwise_factor;
         if(!neighbor2_state)
-            b *= PAIRWISE_FACTOR;
+            b *= request.pairwise_factor;
         if(!neighbor3_state)
-            b *= PAIRWISE_FACTOR;
+            b *= request.pairwise_factor;
         if(!neighbor4_state)
-            b *= PAIRWISE_FACTOR;
+            b *= request.pairwise_factor;
 
         a = a/(a+b);
 
 #ifdef _WIN32
         return ((double) rand() / (double) RAND_MAX) > a;
 #else
-        return drand48() > a;
+        return erand48(request.random_state) > a;
 #endif
     }
 
 
     // Inferenz mit dem Gibbs-Sampling-Algorithmus
-    CImg<unsigned char>* inference_gibbs(CImg<unsigned char>& image, const char* intermediate_result)
+    CImg<unsigned char>* inference_gibbs(CImg<unsigned char>& image, const char* intermediate_result, InferenceRequest& request)
     {
-        int grid_width = image.width() - 2*WINDOW_RADIUS;
-        int grid_height = image.height() - 2*WINDOW_RADIUS;
+        const int radius = parameters.window_radius;
+        int grid_width = image.width() - 2*radius;
+        int grid_height = image.height() - 2*radius;
 
         CImg<float>* unary_pots = new CImg<float>(image.width(), image.height(), 1, 1, 0);
-        cimg_for_insideXY(image, x, y, WINDOW_RADIUS) {
-            double foreground_probability = inference(image, x, y);
+        cimg_for_insideXY(image, x, y, radius) {
+            double foreground_probability = inference(image, x, y, request);
 
             if(foreground_probability < 0.0001) {
                 foreground_probability = 0.0001;
@@ -1085,7 +5372,7 @@ public:
 
         if(intermediate_result != NULL) {
             CImg<unsigned char> intermediate(image.width(), image.height(), 1, 1, 0);
-            cimg_for_insideXY(intermediate, x, y, WINDOW_RADIUS) {
+            cimg_for_insideXY(intermediate, x, y, radius) {
                 intermediate(x, y) = static_cast<unsigned char>((*unary_pots)(x, y) * 255);
             }
             intermediate.save(intermediate_result);
@@ -1100,39 +5387,43 @@ public:
 
         // Anfangsbelegung zufällig initialisieren (alles 0 oder 1)
         cimg_forXY((*y_t), x, y) {
+#ifdef _WIN32
             (*y_t)(x, y) = rand() % 2;
+#else
+            (*y_t)(x, y) = nrand48(request.random_state) % 2;
+#endif
         }
 
-        for(unsigned int versuch = 0; versuch < GIBBS_SAMPLING_STEPS+10; ++versuch) {
+        for(unsigned int versuch = 0; versuch < request.gibbs_sampling_steps+10; ++versuch) {
             if(versuch % 100 == 0) {
-                std::cout << "Sampling-Schritt " << versuch << " von " << GIBBS_SAMPLING_STEPS << std::endl;
+                std::cout << "Sampling-Schritt " << versuch << " von " << request.gibbs_sampling_steps << std::endl;
             }
 
             // die Variablen in y_t einzeln sampeln, basierend auf den
             // aktuellen Belegungen der Nachbarvariablen
 
             // erst die 4 Ecken
-            (*y_t)(0, 0) = sample_corner_variable((*y_t)(1, 0), (*y_t)(0, 1), (*unary_pots)(0+WINDOW_RADIUS, 0+WINDOW_RADIUS));
-            (*y_t)(grid_width-1, 0) = sample_corner_variable((*y_t)(grid_width-2, 0), (*y_t)(grid_width-1, 1), (*unary_pots)(grid_width-1+WINDOW_RADIUS, 0+WINDOW_RADIUS));
-            (*y_t)(0, grid_height-1) = sample_corner_variable((*y_t)(0, grid_height-2), (*y_t)(1, grid_height-1), (*unary_pots)(0+WINDOW_RADIUS, grid_height-1+WINDOW_RADIUS));
-            (*y_t)(grid_width-1, grid_height-1) = sample_corner_variable((*y_t)(grid_width-2, grid_height-1), (*y_t)(grid_width-1, grid_height-2), (*unary_pots)(grid_width-1+WINDOW_RADIUS, grid_height-1+WINDOW_RADIUS));
+            (*y_t)(0, 0) = sample_corner_variable((*y_t)(1, 0), (*y_t)(0, 1), (*unary_pots)(0+radius, 0+radius), request);
+            (*y_t)(grid_width-1, 0) = sample_corner_variable((*y_t)(grid_width-2, 0), (*y_t)(grid_width-1, 1), (*unary_pots)(grid_width-1+radius, 0+radius), request);
+            (*y_t)(0, grid_height-1) = sample_corner_variable((*y_t)(0, grid_height-2), (*y_t)(1, grid_height-1), (*unary_pots)(0+radius, grid_height-1+radius), request);
+            (*y_t)(grid_width-1, grid_height-1) = sample_corner_variable((*y_t)(grid_width-2, grid_height-1), (*y_t)(grid_width-1, grid_height-2), (*unary_pots)(grid_width-1+radius, grid_height-1+radius), request);
 
             // dann die Kanten links und rechts
             for(int y = 1; y < grid_height-1; ++y) {
-                (*y_t)(0, y) = sample_edge_variable((*y_t)(0, y-1), (*y_t)(0, y+1), (*y_t)(1, y), (*unary_pots)(0+WINDOW_RADIUS, y+WINDOW_RADIUS));
-                (*y_t)(grid_width-1, y) = sample_edge_variable((*y_t)(grid_width-1, y-1), (*y_t)(grid_width-1, y+1), (*y_t)(grid_width-2, y), (*unary_pots)(grid_width-1+WINDOW_RADIUS, y+WINDOW_RADIUS));
+                (*y_t)(0, y) = sample_edge_variable((*y_t)(0, y-1), (*y_t)(0, y+1), (*y_t)(1, y), (*unary_pots)(0+radius, y+radius), request);
+                (*y_t)(grid_width-1, y) = sample_edge_variable((*y_t)(grid_width-1, y-1), (*y_t)(grid_width-1, y+1), (*y_t)(grid_width-2, y), (*unary_pots)(grid_width-1+radius, y+radius), request);
             }
 
             // Kanten oben und unten
             for(int x = 1; x < grid_width-1; ++x) {
-                (*y_t)(x, 0) = sample_edge_variable((*y_t)(x-1, 0), (*y_t)(x+1, 0), (*y_t)(x, 1), (*unary_pots)(x+WINDOW_RADIUS, 0+WINDOW_RADIUS));
-                (*y_t)(x, grid_height-1) = sample_edge_variable((*y_t)(x-1, grid_height-1), (*y_t)(x+1, grid_height-1), (*y_t)(x, grid_height-2), (*unary_pots)(x+WINDOW_RADIUS, grid_height-1+WINDOW_RADIUS));
+                (*y_t)(x, 0) = sample_edge_variable((*y_t)(x-1, 0), (*y_t)(x+1, 0), (*y_t)(x, 1), (*unary_pots)(x+radius, 0+radius), request);
+                (*y_t)(x, grid_height-1) = sample_edge_variable((*y_t)(x-1, grid_height-1), (*y_t)(x+1, grid_height-1), (*y_t)(x, grid_height-2), (*unary_pots)(x+radius, grid_height-1+radius), request);
             }
 
             // Variablen innen
             for(int x = 1; x < grid_width-1; ++x) {
                 for(int y = 1; y < grid_height-1; ++y) {
-                    (*y_t)(x, y) = sample_inner_variable((*y_t)(x-1, y), (*y_t)(x+1, y), (*y_t)(x, y-1), (*y_t)(x, y+1), (*unary_pots)(x+WINDOW_RADIUS, y+WINDOW_RADIUS));
+                    (*y_t)(x, y) = sample_inner_variable((*y_t)(x-1, y), (*y_t)(x+1, y), (*y_t)(x, y-1), (*y_t)(x, y+1), (*unary_pots)(x+radius, y+radius), request);
                 }
             }
 
@@ -1147,8 +5438,8 @@ public:
         delete unary_pots;
 
         CImg<unsigned char>* result = new CImg<unsigned char>(image.width(), image.height(), 1, 1, 0);
-        cimg_for_insideXY((*result), x, y, WINDOW_RADIUS) {
-            (*result)(x, y) = (count_ones(x-WINDOW_RADIUS, y-WINDOW_RADIUS) > (GIBBS_SAMPLING_STEPS/2) ? this->background_color : this->foreground_color);
+        cimg_for_insideXY((*result), x, y, radius) {
+            (*result)(x, y) = (count_ones(x-radius, y-radius) > (request.gibbs_sampling_steps/2) ? this->background_color : this->foreground_color);
         }
 
         return result;
@@ -1160,14 +5451,7 @@ public:
     {
         JSONArray json_root;
 
-        JSONObject learning_parameters;
-        learning_parameters[L"Test Type"] = new JSONValue(T::name);
-        learning_parameters[L"Max tree depth"] = new JSONValue(static_cast<double>(MAX_TREE_DEPTH));
-        learning_parameters[L"Testobject tries"] = new JSONValue(static_cast<double>(TESTOBJECT_TRIES));
-        learning_parameters[L"Forest size"] = new JSONValue(static_cast<double>(FOREST_SIZE));
-        learning_parameters[L"Window radius"] = new JSONValue(static_cast<double>(WINDOW_RADIUS));
-
-        json_root.push_back(new JSONValue(learning_parameters));
+        json_root.push_back(new JSONValue(learning_parameters_json<T>(parameters, trees.size() + ferns.size(), NULL, NULL)));
 
         json_root.push_back(new JSONValue(static_cast<double>(this->background_color)));
         json_root.push_back(new JSONValue(static_cast<double>(this->foreground_color)));
@@ -1175,6 +5459,9 @@ public:
         for(typename std::vector<Tree<T>*>::iterator it = trees.begin(); it != trees.end(); ++it) {
             json_root.push_back((*it)->to_json());
         }
+        for(typename std::vector<Fern<T>*>::iterator it = ferns.begin(); it != ferns.end(); ++it) {
+            json_root.push_back((*it)->to_json());
+        }
 
         JSONValue *root_value = new JSONValue(json_root);
 
@@ -1203,17 +5490,44 @@ public:
         JSONArray root_array = value->AsArray();
 
         JSONObject learning_parameters = root_array.at(0)->AsObject();
-        FOREST_SIZE = static_cast<unsigned short>(learning_parameters[L"Forest size"]->AsNumber());
-        TESTOBJECT_TRIES = static_cast<unsigned int>(learning_parameters[L"Testobject tries"]->AsNumber());
-        MAX_TREE_DEPTH = static_cast<unsigned short>(learning_parameters[L"Max tree depth"]->AsNumber());
-        WINDOW_RADIUS = static_cast<unsigned char>(learning_parameters[L"Window radius"]->AsNumber());
-        WINDOW_SIZE = (2*WINDOW_RADIUS)+1;
+        if(learning_parameters[L"Test Type"]->AsString() != T::name) {
+            std::cerr << "Fehler: " << filename << " enthält Bäume mit einem anderen Testtyp" << std::endl;
+            std::exit(1);
+        }
+        ForestParameters& parameters = forest.parameters;
+        parameters.forest_size = static_cast<unsigned short>(learning_parameters[L"Forest size"]->AsNumber());
+        parameters.testobject_tries = static_cast<unsigned int>(learning_parameters[L"Testobject tries"]->AsNumber());
+        parameters.max_tree_depth = static_cast<unsigned short>(learning_parameters[L"Max tree depth"]->AsNumber());
+        parameters.set_window_radius(static_cast<unsigned char>(learning_parameters[L"Window radius"]->AsNumber()));
+        offset_pool_from_json(learning_parameters, parameters.offset_pool);
+        tree_origin_from_json(learning_parameters, parameters);
 
         forest.background_color = root_array[1]->AsNumber();
         forest.foreground_color = root_array[2]->AsNumber();
 
+        // ältere Modelle haben keinen Modelltyp und sind immer Bäume
+        parameters.model_type = 0;
+        JSONObject::iterator model_type = learning_parameters.find(L"Model type");
+        if(model_type != learning_parameters.end() && model_type->second->AsString() == L"Random ferns") {
+            parameters.model_type = 1;
+        }
+
         for(unsigned int i = 3; i < root_array.size(); ++i) {
-            forest.trees.push_back(Tree<T>::from_json(root_array[i]));
+            if(parameters.model_type == 1) {
+                forest.ferns.push_back(Fern<T>::from_json(root_array[i], parameters));
+            } else {
+                forest.trees.push_back(Tree<T>::from_json(root_array[i], parameters));
+            }
+        }
+
+        // die Differenzen können nur geteilt werden, wenn alle Bäume (z.B.
+        // auch die aus einem Warmstart) ihre Offsets aus dem Pool haben
+        forest.use_offset_pool = !parameters.offset_pool.empty();
+        for(size_t i = 0; i < forest.trees.size(); ++i) {
+            forest.use_offset_pool = forest.use_offset_pool && forest.trees[i]->in_offset_pool();
+        }
+        for(size_t i = 0; i < forest.ferns.size(); ++i) {
+            forest.use_offset_pool = forest.use_offset_pool && forest.ferns[i]->in_offset_pool();
         }
 
         delete value;
@@ -1237,7 +5551,7 @@ public:
         // zählt true-negative, false-negative, false-positive und true-positive
         unsigned long count_right_and_wrong[4] = { 0, 0, 0, 0 };
 
-        cimg_for_insideXY((*result), x, y, WINDOW_RADIUS) {
+        cimg_for_insideXY((*result), x, y, parameters.window_radius) {
             unsigned char gt_label = ground_truth(x, y);
             if(gt_label > 0) {
                 bool result_is_foreground = (*result)(x, y) == this->foreground_color;
@@ -1267,27 +5581,221 @@ extern "C" {
 #ifdef _WIN32
     __declspec(dllexport)
 #endif
-void training(unsigned int number_of_training_images, const char** training_images, const char** label_images, const char* target_json_file, unsigned int forest_size, unsigned int max_tree_depth, unsigned int testobject_tries, unsigned int window_radius, unsigned int number_of_threads)
+void training(unsigned int number_of_training_images, const char** training_images, const char** label_images, const char* target_json_file, unsigned int forest_size, unsigned int max_tree_depth, unsigned int testobject_tries, unsigned int window_radius, unsigned int number_of_threads, int copy_sample_windows, unsigned int growth_mode, unsigned int max_tree_leaves, int subsampled_split_scoring, const char* cache_file, const char* warm_start_json_file, int resume, unsigned int first_tree_index, unsigned int random_seed, int out_of_core, double time_budget, double out_of_bag_fraction, int deduplicate_samples, unsigned int augmentation_variants, int augmentation_flips, double augmentation_max_angle, double augmentation_max_gain, unsigned int offset_pool_size, unsigned int model_type, unsigned int jungle_width)
 {
     install_signal_handler();
 
-    FOREST_SIZE = forest_size;
-    TESTOBJECT_TRIES = testobject_tries;
-    MAX_TREE_DEPTH = max_tree_depth;
-    WINDOW_RADIUS = window_radius;
-    WINDOW_SIZE = 2*WINDOW_RADIUS + 1;
+    Forest<PixelDifferenceTest> forest;
+    ForestParameters& parameters = forest.parameters;
+    parameters.forest_size = forest_size;
+    parameters.testobject_tries = testobject_tries;
+    parameters.max_tree_depth = max_tree_depth;
+    parameters.set_window_radius(window_radius);
+    parameters.model_type = model_type;
+
+    TrainingSettings settings;
+    settings.copy_sample_windows = (copy_sample_windows != 0);
+    settings.growth_mode = growth_mode;
+    settings.max_tree_leaves = max_tree_leaves;
+    settings.subsampled_split_scoring = (subsampled_split_scoring != 0);
+    settings.time_budget = time_budget;
+    settings.out_of_bag_fraction = out_of_bag_fraction;
+    settings.deduplicate_samples = (deduplicate_samples != 0);
+    settings.augmentation_variants = augmentation_variants;
+    settings.augmentation_flips = (augmentation_flips != 0);
+    settings.augmentation_max_angle = augmentation_max_angle;
+    settings.augmentation_max_gain = augmentation_max_gain;
+    settings.offset_pool_size = offset_pool_size;
+    settings.jungle_width = jungle_width;
+    if(settings.growth_mode == 3 && settings.jungle_width < 2) {
+        std::cerr << "Fehler: Eine Ebene eines Dschungels braucht mindestens 2 Knoten" << std::endl;
+        std::exit(1);
+    }
+    if(parameters.model_type == 1 && (parameters.max_tree_depth > 20 || warm_start_json_file != NULL || resume != 0 || settings.out_of_bag_fraction > 0.0)) {
+        std::cerr << "Fehler: Ein Farn hat höchstens 20 Testobjekte, und Warmstart, Fortsetzen und Out-of-bag-Schätzung gibt es nur für Bäume" << std::endl;
+        std::exit(1);
+    }
+    // Farne wachsen nicht und zählen ihre Pixel ohne SampleStore, diese
+    // Einstellungen hätten also keine Wirkung
+    if(parameters.model_type == 1 && (settings.growth_mode != 0 || settings.max_tree_leaves > 0 || settings.subsampled_split_scoring || settings.copy_sample_windows || settings.deduplicate_samples || settings.augmentation_variants > 0 || settings.time_budget > 0.0)) {
+        std::cerr << "Fehler: Wachstumsart, Blattgrenze, Vorauswahl auf Stichproben, kopierte Fenster, Zusammenfassen, Augmentierung und Zeitbudget gibt es nur für Bäume" << std::endl;
+        std::exit(1);
+    }
+    if(settings.offset_pool_size > 32767) {
+        std::cerr << "Fehler: Der Offset-Pool hat höchstens 32767 Paare" << std::endl;
+        std::exit(1);
+    }
+    if(settings.augmentation_variants > 16 || settings.augmentation_max_gain < 0.0 || settings.augmentation_max_gain >= 1.0) {
+        std::cerr << "Fehler: Es gibt höchstens 16 Varianten für die Augmentierung, und die Kontraständerung muss mindestens 0 und kleiner als 1 sein" << std::endl;
+        std::exit(1);
+    }
+    if(settings.out_of_bag_fraction < 0.0 || settings.out_of_bag_fraction >= 1.0) {
+        std::cerr << "Fehler: Der zurückgehaltene Anteil der Vordergrundpixel muss mindestens 0 und kleiner als 1 sein" << std::endl;
+        std::exit(1);
+    }
+
+    // beim Auslagern liegen die Bilder im Trainings-Cache und die Fenster der
+    // Trainingsbeispiele in Dateien daneben
+    if(out_of_core != 0) {
+        if(cache_file == NULL) {
+            std::cerr << "Fehler: Zum Auslagern der Trainingsdaten wird ein Trainings-Cache gebraucht" << std::endl;
+            std::exit(1);
+        }
+        settings.out_of_core_prefix = cache_file;
+        settings.copy_sample_windows = true;
+    }
+
+    settings.number_of_threads = number_of_threads;
+    settings.random_seed = random_seed;
+    settings.first_tree_index = first_tree_index;
+    parameters.has_tree_origin = true;
+    parameters.random_seed = random_seed;
+    parameters.first_tree_index = first_tree_index;
+
+    // alle Teilwälder mit demselben random_seed bekommen denselben
+    // Offset-Pool, damit er beim Zusammenfügen erhalten bleibt. Sein
+    // Zufallsgenerator hat einen Strom, den kein Baum hat.
+    if(settings.offset_pool_size > 0) {
+        Random pool_random(settings.random_seed, ~0ULL);
+        PixelDifferenceTest::draw_offset_pool(parameters, settings.offset_pool_size, pool_random);
+    }
 
-#ifdef _OPENMP
-    if(number_of_threads >= 1) {
-        omp_set_num_threads(number_of_threads);
+    // Beim Training auf mehreren Rechnern (oder in mehreren Prozessen)
+    // trainiert jeder Prozess einen Teilwald mit den Bäumen first_tree_index
+    // bis first_tree_index + forest_size - 1. Danach werden sie mit
+    // merge_forests zusammengefügt. Weil jeder Baum seinen Zufallsgenerator
+    // aus random_seed und seinem Index im ganzen Wald bekommt (siehe
+    // TrainingData), werden alle Bäume verschieden, und mit demselben
+    // random_seed ergeben die Teilwälder zusammen dieselben Bäume wie ein
+    // einziges Training (nur eventuell in anderer Reihenfolge).
+    if(first_tree_index != 0) {
+        std::cout << "Teilwald mit den Bäumen " << first_tree_index + 1 << " bis " << first_tree_index + forest_size << std::endl;
     }
-#endif
 
     // die String-Listen von char** nach vector<string> umwandeln
     std::vector<std::string> ti(training_images, training_images + number_of_training_images);
     std::vector<std::string> li(label_images, label_images + number_of_training_images);
 
-    Forest<PixelDifferenceTest> forest = Forest<PixelDifferenceTest>::train(ti, li);
+    LabeledImages* data = LabeledImages::load(ti, li, cache_file, parameters.window_radius, out_of_core != 0);
+
+    forest.background_color = data->background_color;
+    forest.foreground_color = data->foreground_color;
+
+    // Farne sind schnell trainiert und brauchen keinen Zwischenstand
+    if(parameters.model_type == 1) {
+        forest.train_ferns(*data, settings);
+        delete data;
+        forest.write_to_file(target_json_file);
+        return;
+    }
+
+    // jeder fertige Baum wird sofort in den Zwischenstand geschrieben, damit
+    // bei einem Abbruch nicht alles verloren ist
+    TreeCheckpoint<PixelDifferenceTest> checkpoint(std::string(target_json_file) + ".baeume", parameters);
+
+    // ein fortgesetzter Zwischenstand enthält auch schon die Bäume aus
+    // warm_start_json_file
+    if(resume == 0 || !checkpoint.resume(data->background_color, data->foreground_color)) {
+        checkpoint.start(data->background_color, data->foreground_color);
+
+        if(warm_start_json_file != NULL) {
+            // einen schon trainierten Wald laden und um weitere Bäume
+            // ergänzen, bis er forest_size Bäume hat
+            Forest<PixelDifferenceTest> warm_start_forest = Forest<PixelDifferenceTest>::load_from_file(warm_start_json_file);
+            const ForestParameters& loaded = warm_start_forest.parameters;
+
+            if(loaded.model_type != 0) {
+                std::cerr << "Fehler: " << warm_start_json_file << " enthält Farne und keine Bäume" << std::endl;
+                std::exit(1);
+            }
+            if(loaded.window_radius != parameters.window_radius) {
+                std::cerr << "Fehler: " << warm_start_json_file << " wurde mit Fensterradius " << static_cast<int>(loaded.window_radius) << " trainiert, nicht mit " << static_cast<int>(parameters.window_radius) << std::endl;
+                std::exit(1);
+            }
+            // der Kopf des Walds gilt für alle Bäume, also müssen auch Tiefe
+            // und Versuche zu den alten Bäumen passen
+            if(loaded.max_tree_depth != parameters.max_tree_depth || loaded.testobject_tries != parameters.testobject_tries) {
+                std::cerr << "Fehler: " << warm_start_json_file << " wurde mit Tiefe " << loaded.max_tree_depth << " und " << loaded.testobject_tries << " Versuchen trainiert, nicht mit Tiefe " << parameters.max_tree_depth << " und " << parameters.testobject_tries << " Versuchen" << std::endl;
+                std::exit(1);
+            }
+            if(warm_start_forest.background_color != data->background_color || warm_start_forest.foreground_color != data->foreground_color) {
+                std::cerr << "Fehler: Die Labelfarben in " << warm_start_json_file << " passen nicht zu den Labelbildern" << std::endl;
+                std::exit(1);
+            }
+
+            // mit Pool nehmen die neuen Bäume ihre Offsets aus dem des
+            // geladenen Walds, damit der ganze Wald ihn bei der Inferenz
+            // teilen kann. Der muss also einen mit der gewünschten Größe
+            // haben.
+            if(settings.offset_pool_size > 0) {
+                if(loaded.offset_pool.size() != 4*settings.offset_pool_size) {
+                    std::cerr << "Fehler: " << warm_start_json_file << " hat einen Offset-Pool mit " << loaded.offset_pool.size() / 4 << " Paaren, nicht mit " << settings.offset_pool_size << std::endl;
+                    std::exit(1);
+                }
+                parameters.offset_pool = loaded.offset_pool;
+            }
+
+            // die alten Bäume sind nur dann die ersten des Walds mit diesem
+            // Startwert, wenn der geladene Wald das auch sagt; sonst lässt
+            // der Kopf die Herkunft weg
+            if(!loaded.has_tree_origin || loaded.random_seed != parameters.random_seed || loaded.first_tree_index != parameters.first_tree_index) {
+                parameters.has_tree_origin = false;
+            }
+
+            // der Kopf des Zwischenstands braucht den übernommenen Pool und
+            // die Herkunft
+            checkpoint.start(data->background_color, data->foreground_color);
+
+            for(size_t i = 0; i < warm_start_forest.trees.size(); ++i) {
+                checkpoint.append(warm_start_forest.trees[i]);
+            }
+        }
+    }
+
+    if(checkpoint.number_of_trees >= parameters.forest_size) {
+        std::cout << "Der Wald hat schon " << checkpoint.number_of_trees << " Bäume" << std::endl;
+    }
+
+    // die Schätzung bezieht sich nur auf die Bäume, die jetzt trainiert
+    // werden, nicht auf die aus warm_start_json_file oder dem Zwischenstand
+    OutOfBagEstimate* out_of_bag = NULL;
+    if(settings.out_of_bag_fraction > 0.0) {
+        out_of_bag = new OutOfBagEstimate(*data, settings.out_of_bag_fraction, settings.out_of_core_prefix);
+    }
+
+    forest.train_trees(*data, parameters.forest_size, settings, &checkpoint, out_of_bag);
+
+    checkpoint.write_forest(target_json_file, out_of_bag, data);
+
+    delete out_of_bag;
+    delete data;
+}
+
+
+#ifdef _WIN32
+    __declspec(dllexport)
+#endif
+void refit(unsigned int number_of_training_images, const char** training_images, const char** label_images, const char* json_file, const char* target_json_file, int keep_counts, unsigned int number_of_threads, const char* cache_file)
+{
+    install_signal_handler();
+
+    // der Fensterradius des Walds wird auch für das Einteilen der Pixel
+    // gebraucht
+    Forest<PixelDifferenceTest> forest = Forest<PixelDifferenceTest>::load_from_file(json_file);
+
+    std::vector<std::string> ti(training_images, training_images + number_of_training_images);
+    std::vector<std::string> li(label_images, label_images + number_of_training_images);
+
+    LabeledImages* data = LabeledImages::load(ti, li, cache_file, forest.parameters.window_radius, false);
+
+    if(forest.background_color != data->background_color || forest.foreground_color != data->foreground_color) {
+        std::cerr << "Fehler: Die Labelfarben in " << json_file << " passen nicht zu den Labelbildern" << std::endl;
+        std::exit(1);
+    }
+
+    forest.refit(*data, keep_counts != 0, number_of_threads);
+
+    delete data;
 
     forest.write_to_file(target_json_file);
 }
@@ -1296,14 +5804,167 @@ void training(unsigned int number_of_training_images, const char** training_imag
 #ifdef _WIN32
     __declspec(dllexport)
 #endif
-void inference(const char* input_image_filename, const char* json_file, const char* result_filename, double edge_weight, int inference_method, const char* intermediate_result, const char* ground_truth_image, int gibbs_sampling_steps)
+void truncate_forest(const char* json_file, const char* target_json_file, unsigned int max_tree_depth)
+{
+    install_signal_handler();
+
+    Forest<PixelDifferenceTest> forest = Forest<PixelDifferenceTest>::load_from_file(json_file);
+
+    if(max_tree_depth < 1) {
+        std::cerr << "Fehler: Die Tiefe muss mindestens 1 sein" << std::endl;
+        std::exit(1);
+    }
+    if(forest.parameters.model_type == 1) {
+        std::cerr << "Fehler: " << json_file << " enthält Farne, die nicht abgeschnitten werden können" << std::endl;
+        std::exit(1);
+    }
+    if(max_tree_depth >= forest.parameters.max_tree_depth) {
+        std::cout << json_file << " hat nur die Tiefe " << forest.parameters.max_tree_depth << std::endl;
+    } else {
+        if(!forest.truncate(max_tree_depth)) {
+            std::cerr << "Fehler: " << json_file << " enthält keine Anzahlen in den inneren Knoten und kann nicht abgeschnitten werden" << std::endl;
+            std::exit(1);
+        }
+        forest.parameters.max_tree_depth = max_tree_depth;
+    }
+
+    forest.write_to_file(target_json_file);
+}
+
+
+// merkt sich alle Bäume und Farne aus forest (aus der Datei mit der Nummer
+// file) als JSON. Gibt es einen davon schon, bricht das Programm ab.
+void add_known_trees(Forest<PixelDifferenceTest>& forest, unsigned int file, const char** json_files, std::map<std::wstring, unsigned int>& known_trees)
+{
+    std::vector<JSONValue*> values;
+    for(size_t t = 0; t < forest.trees.size(); ++t) {
+        values.push_back(forest.trees[t]->to_json());
+    }
+    for(size_t f = 0; f < forest.ferns.size(); ++f) {
+        values.push_back(forest.ferns[f]->to_json());
+    }
+
+    bool duplicate = false;
+    unsigned int other_file = 0;
+    for(size_t v = 0; v < values.size(); ++v) {
+        if(!duplicate) {
+            std::pair<std::map<std::wstring, unsigned int>::iterator, bool> inserted = known_trees.insert(std::make_pair(values[v]->Stringify(false), file));
+            duplicate = !inserted.second;
+            other_file = inserted.first->second;
+        }
+        delete values[v];
+    }
+    if(duplicate) {
+        std::cerr << "Fehler: " << json_files[file] << " enthält einen Baum, den es in " << json_files[other_file] << " auch gibt" << std::endl;
+        std::exit(1);
+    }
+}
+
+
+#ifdef _WIN32
+    __declspec(dllexport)
+#endif
+void merge_forests(unsigned int number_of_json_files, const char** json_files, const char* target_json_file)
 {
     install_signal_handler();
 
-    PAIRWISE_ENERGY = edge_weight;
-    PAIRWISE_FACTOR = exp(-PAIRWISE_ENERGY);
+    if(number_of_json_files == 0) {
+        std::cerr << "Fehler: Keine Wälder zum Zusammenfügen angegeben" << std::endl;
+        std::exit(1);
+    }
+
+    // load_from_file prüft schon den Testtyp; alle Wälder müssen dieselbe
+    // Fenstergröße und dieselben Labelfarben haben
+    Forest<PixelDifferenceTest> merged = Forest<PixelDifferenceTest>::load_from_file(json_files[0]);
+    ForestParameters& parameters = merged.parameters;
+
+    // die Herkunft jedes Teilwalds, um Überschneidungen zu finden
+    std::vector<ForestParameters> origins(1, parameters);
+    origins[0].forest_size = static_cast<unsigned short>(merged.trees.size() + merged.ferns.size());
+    origins[0].offset_pool.clear();
+
+    // jeder Baum als JSON, um auch ohne Herkunft doppelte Bäume zu finden.
+    // Dazu die Nummer der Datei, aus der er kommt.
+    std::map<std::wstring, unsigned int> known_trees;
+    add_known_trees(merged, 0, json_files, known_trees);
+
+    for(unsigned int i = 1; i < number_of_json_files; ++i) {
+        Forest<PixelDifferenceTest> part = Forest<PixelDifferenceTest>::load_from_file(json_files[i]);
+        if(part.parameters.window_radius != parameters.window_radius) {
+            std::cerr << "Fehler: " << json_files[i] << " wurde mit Fensterradius " << static_cast<int>(part.parameters.window_radius) << " trainiert, " << json_files[0] << " mit " << static_cast<int>(parameters.window_radius) << std::endl;
+            std::exit(1);
+        }
+        if(part.parameters.model_type != parameters.model_type) {
+            std::cerr << "Fehler: " << json_files[i] << " und " << json_files[0] << " enthalten verschiedene Modelle" << std::endl;
+            std::exit(1);
+        }
+        // der Kopf des Walds gilt für alle Bäume, also müssen Tiefe und
+        // Versuche wie beim Warmstart übereinstimmen
+        if(part.parameters.max_tree_depth != parameters.max_tree_depth || part.parameters.testobject_tries != parameters.testobject_tries) {
+            std::cerr << "Fehler: " << json_files[i] << " wurde mit Tiefe " << part.parameters.max_tree_depth << " und " << part.parameters.testobject_tries << " Versuchen trainiert, " << json_files[0] << " mit Tiefe " << parameters.max_tree_depth << " und " << parameters.testobject_tries << " Versuchen" << std::endl;
+            std::exit(1);
+        }
+        if(part.background_color != merged.background_color || part.foreground_color != merged.foreground_color) {
+            std::cerr << "Fehler: Die Labelfarben in " << json_files[i] << " und " << json_files[0] << " sind verschieden" << std::endl;
+            std::exit(1);
+        }
+
+        // zwei Teilwälder mit demselben Startwert dürfen keinen Index
+        // gemeinsam haben, sonst kommen Bäume doppelt in den Wald
+        ForestParameters origin = part.parameters;
+        origin.forest_size = static_cast<unsigned short>(part.trees.size() + part.ferns.size());
+        origin.offset_pool.clear();
+        for(unsigned int j = 0; j < i; ++j) {
+            if(origin.has_tree_origin && origins[j].has_tree_origin && origin.random_seed == origins[j].random_seed &&
+                    origin.first_tree_index < origins[j].first_tree_index + origins[j].forest_size &&
+                    origins[j].first_tree_index < origin.first_tree_index + origin.forest_size) {
+                std::cerr << "Fehler: " << json_files[i] << " und " << json_files[j] << " enthalten beide Bäume mit Startwert " << origin.random_seed << " und demselben Index" << std::endl;
+                std::exit(1);
+            }
+        }
+        origins.push_back(origin);
+        add_known_trees(part, i, json_files, known_trees);
+
+        // Teilwälder mit verschiedenen Offset-Pools werden ohne Pool
+        // zusammengefügt; die Inferenz rechnet dann wieder jedes Testobjekt
+        // einzeln aus
+        if(part.parameters.offset_pool != parameters.offset_pool) {
+            parameters.offset_pool.clear();
+        }
+
+        // die Bäume gehören danach dem zusammengefügten Wald
+        merged.trees.insert(merged.trees.end(), part.trees.begin(), part.trees.end());
+        part.trees.clear();
+        merged.ferns.insert(merged.ferns.end(), part.ferns.begin(), part.ferns.end());
+        part.ferns.clear();
+    }
+
+    // der zusammengefügte Wald hat eine Herkunft, wenn alle Teilwälder
+    // denselben Startwert haben und ihre Indizes lückenlos aneinander passen
+    std::vector<std::pair<unsigned int, unsigned int> > ranges;
+    for(size_t i = 0; i < origins.size(); ++i) {
+        parameters.has_tree_origin = parameters.has_tree_origin && origins[i].has_tree_origin && origins[i].random_seed == parameters.random_seed;
+        ranges.push_back(std::make_pair(origins[i].first_tree_index, origins[i].first_tree_index + origins[i].forest_size));
+    }
+    std::sort(ranges.begin(), ranges.end());
+    for(size_t i = 1; i < ranges.size(); ++i) {
+        parameters.has_tree_origin = parameters.has_tree_origin && ranges[i].first == ranges[i - 1].second;
+    }
+    parameters.first_tree_index = ranges[0].first;
+
+    // write_to_file schreibt die Anzahl der Bäume selbst
+    merged.write_to_file(target_json_file);
+}
+
+
+#ifdef _WIN32
+    __declspec(dllexport)
+#endif
+void inference(const char* input_image_filename, const char* json_file, const char* result_filename, double edge_weight, int inference_method, const char* intermediate_result, const char* ground_truth_image, int gibbs_sampling_steps)
+{
+    install_signal_handler();
 
-    GIBBS_SAMPLING_STEPS = gibbs_sampling_steps;
+    InferenceRequest request(edge_weight, gibbs_sampling_steps);
 
     Forest<PixelDifferenceTest> forest = Forest<PixelDifferenceTest>::load_from_file(json_file);
 
@@ -1315,8 +5976,8 @@ void inference(const char* input_image_filename, const char* json_file, const ch
         std::exit(1);
     }
     CImg<unsigned char>* result = (inference_method == 0 ?
-            forest.inference_maxflow(input_image, intermediate_result) :
-            forest.inference_gibbs(input_image, intermediate_result));
+            forest.inference_maxflow(input_image, intermediate_result, request) :
+            forest.inference_gibbs(input_image, intermediate_result, request));
 
 
     if(ground_truth_image != NULL) {
@@ -1341,20 +6002,45 @@ int main(int argc, char const *argv[])
     std::vector<std::string> param_vector(argv, argv+argc);
 
 
-    std::string usage = "Beispiel:\n\n    Training: " + param_vector[0] + " training  -i trainingsbild1.png trainingsbild2.png  -l labels1.png labels2.png  -f forest.json  -d 8  -p 300  -t 10  -w 6\n\n    Inferenz: " + param_vector[0] + " inferenz  -i karte.png  -f forest.json  -l ausgabe.png  -e 10  -m maxflow\n";
+    std::string usage = "Beispiel:\n\n    Training: " + param_vector[0] + " training  -i trainingsbild1.png trainingsbild2.png  -l labels1.png labels2.png  -f forest.json  -d 8  -p 300  -t 10  -w 6\n\n    Nachtrainieren: " + param_vector[0] + " nachtrainieren  -i neuesbild.png  -l neuelabels.png  -f forest.json  -n forest_neu.json\n\n    Abschneiden: " + param_vector[0] + " abschneiden  -f forest.json  -d 5  -n forest_tiefe5.json\n\n    Zusammenfügen: " + param_vector[0] + " zusammenfuegen  -i teil1.json teil2.json  -f forest.json\n\n    Inferenz: " + param_vector[0] + " inferenz  -i karte.png  -f forest.json  -l ausgabe.png  -e 10  -m maxflow\n";
 
     cimg_usage(usage.c_str());
 
     bool do_training = cimg_option("training", false, "Training");
     bool do_inference = cimg_option("inferenz", false, "Inferenz");
+    bool do_refit = cimg_option("nachtrainieren", false, "Blätter eines trainierten Walds an neue Labelbilder anpassen");
+    bool do_truncate = cimg_option("abschneiden", false, "Bäume eines trainierten Walds auf die Tiefe bei -d abschneiden");
+    bool do_merge = cimg_option("zusammenfuegen", false, "Die Wälder bei -i zu einem Wald zusammenfügen, der bei -f gespeichert wird");
     const char* input_image_filename = cimg_option("-i", "karte.png", "Eingabebild für das Training bzw. Inferenz");
     const char* forest_file = cimg_option("-f", "forest.json", "Ausgabe- bzw. Eingabedatei mit dem Random Forest");
     const char* label_image_filename = cimg_option("-l", "karte_labels.png", "Eingabe- bzw. Ausgabebild mit Labels");
-    unsigned short max_tree_depth = cimg_option("-d", 8, "Tiefe der Bäume (beim Training)");
+    unsigned short max_tree_depth = cimg_option("-d", 8, "Tiefe der Bäume (beim Training und Abschneiden)");
     unsigned int testobject_tries = cimg_option("-p", 200, "Anzahl der Versuche für die Testknoten (beim Training)");
     unsigned short forest_size = cimg_option("-t", 20, "Anzahl der Bäume im Wald (beim Training)");
     unsigned char window_radius = cimg_option("-w", 4, "Radius der Fensterchen (beim Training)");
     unsigned int number_of_threads = cimg_option("-o", 1, "Anzahl der Threads (beim Training)");
+    bool copy_sample_windows = cimg_option("-s", false, "Fenster der Trainingsbeispiele in einen zusammenhängenden Puffer kopieren (beim Training)");
+    bool subsampled_split_scoring = cimg_option("-u", false, "Testobjekte in großen Knoten erst auf Stichproben bewerten (beim Training)");
+    const char* cache_file = cimg_option("-c", (const char*)NULL, "Datei für den Trainings-Cache, in dem die gelesenen Trainingsbilder zwischengespeichert werden (beim Training)");
+    unsigned int first_tree_index = cimg_option("-x", 0, "Index des ersten Baums, wenn nur ein Teilwald trainiert wird, der später mit 'zusammenfuegen' zu einem Wald wird (beim Training)");
+    unsigned int random_seed = cimg_option("-z", 0, "Startwert für die Zufallsgeneratoren der Bäume. Jeder Baum mischt ihn mit seinem Index im ganzen Wald (siehe -x), alle Teilwälder sollten also denselben haben (beim Training)");
+    bool out_of_core = cimg_option("-q", false, "Trainingsdaten auslagern: Bilder und Fenster der Trainingsbeispiele werden aus Dateien neben dem Trainings-Cache (-c) in den Speicher abgebildet, statt im Arbeitsspeicher zu liegen (beim Training)");
+    double time_budget = cimg_option("-j", 0.0, "Zeitbudget in Sekunden. Das Training hört dann rechtzeitig auf und verringert notfalls die Versuche bei -p. 0 heißt ohne Zeitbudget (beim Training)");
+    unsigned int augmentation_variants = cimg_option("-A", 0, "Anzahl der Varianten für die Augmentierung der Trainingsbeispiele (höchstens 16). 0 heißt ohne Augmentierung (beim Training)");
+    bool augmentation_flips = cimg_option("-S", false, "Bei der Augmentierung auch spiegeln (beim Training)");
+    double augmentation_max_angle = cimg_option("-D", 0.0, "Größter Drehwinkel in Grad bei der Augmentierung (beim Training)");
+    double augmentation_max_gain = cimg_option("-K", 0.0, "Größte relative Kontraständerung bei der Augmentierung, z.B. 0.2 für Faktoren zwischen 0.8 und 1.2 (beim Training)");
+    std::string model_type = cimg_option("-M", "baeume", "Modelltyp. Entweder 'baeume' (Entscheidungsbäume) oder 'farne' (Random Ferns mit -d Testobjekten, höchstens 20). Farne sind schneller, aber meist ungenauer. Mit den Optionen -g, -b, -u, -s, -y, -A, -j, -a, -r und -v geht das nicht (beim Training)");
+    unsigned int offset_pool_size = cimg_option("-P", 0, "Anzahl der Pixelpaare im Offset-Pool, aus dem alle Testobjekte ihre Offsets nehmen. Die Inferenz teilt die Differenzen dann zwischen den Bäumen. 0 heißt ohne Pool (beim Training)");
+    bool deduplicate_samples = cimg_option("-y", false, "Trainingsbeispiele mit gleichem Fenster und Label zu einem Beispiel mit Gewicht zusammenfassen (beim Training)");
+    double out_of_bag_fraction = cimg_option("-v", 0.0, "Anteil der Vordergrundpixel, den jeder Baum nicht sieht. Damit wird schon beim Training ein Out-of-bag-F-Maß geschätzt und in der Datei bei -f gespeichert. 0 heißt ohne Schätzung (beim Training)");
+    bool resume = cimg_option("-r", false, "Ein abgebrochenes Training mit dem Zwischenstand in der Datei bei -f plus '.baeume' fortsetzen (beim Training)");
+    const char* warm_start_json_file = cimg_option("-a", (const char*)NULL, "Schon trainierter Wald, der um weitere Bäume ergänzt wird, bis er so viele hat wie bei -t angegeben (beim Training)");
+    const char* refit_json_file = cimg_option("-n", (const char*)NULL, "Ausgabedatei beim Nachtrainieren und Abschneiden. Ohne -n wird die Datei bei -f überschrieben");
+    bool refit_replace_counts = cimg_option("-k", false, "Beim Nachtrainieren nur die neuen Labels zählen, statt sie zu den alten zu addieren");
+    std::string growth_mode = cimg_option("-g", "tiefe", "Wie die Bäume wachsen. Entweder 'tiefe' (Knoten für Knoten), 'ebenen' (Ebene für Ebene), 'beste' (der beste Knoten zuerst) oder 'dschungel' (Ebene für Ebene mit zusammengelegten Knoten, siehe -J) (beim Training)");
+    unsigned int jungle_width = cimg_option("-J", 64, "Höchstens so viele Knoten pro Ebene, wenn die Bäume mit -g dschungel wachsen (beim Training)");
+    unsigned int max_tree_leaves = cimg_option("-b", 0, "Höchstens so viele Blätter pro Baum, wenn die Bäume mit -g beste wachsen. 0 heißt unbegrenzt (beim Training)");
     double pairwise_energy = cimg_option("-e", 10.0, "Konstantes Kantengewicht (bei der Inferenz)");
     std::string inference_method = cimg_option("-m", "maxflow", "Inferenzmethode. Entweder 'maxflow' oder 'gibbs'");
 
@@ -1362,14 +6048,19 @@ int main(int argc, char const *argv[])
         std::exit(0);
     }
 
-    // der Benutzer muss entweder training oder inferenz angeben
-    if(do_training == do_inference) {
+    // der Benutzer muss genau eins von training, nachtrainieren, abschneiden,
+    // zusammenfuegen und inferenz angeben
+    if(do_training + do_inference + do_refit + do_truncate + do_merge != 1) {
         std::cerr << param_vector[0] << " -h für Hinweise zur Benutzung" << std::endl;
         std::exit(1);
     }
 
 
-    if(do_training) {
+    if(do_truncate) {
+
+        truncate_forest(forest_file, (refit_json_file != NULL ? refit_json_file : forest_file), max_tree_depth);
+
+    } else if(do_training || do_refit || do_merge) {
 
         // da hinter -i und -l mehrere Bilder kommen können müssen wir hier
         // selbst sehen, wo die in argv sind
@@ -1388,6 +6079,10 @@ int main(int argc, char const *argv[])
         }
         int training_images_index_to = i-1;
 
+        if(do_merge) {
+            merge_forests(training_images_index_to - training_images_index_from + 1, &argv[training_images_index_from], forest_file);
+            return 0;
+        }
 
         i = 1;
         for(; i < argc; ++i) {
@@ -1412,7 +6107,12 @@ int main(int argc, char const *argv[])
             std::exit(1);
         }
 
-        training(number_of_training_images, &argv[training_images_index_from], &argv[label_images_index_from], forest_file, forest_size, max_tree_depth, testobject_tries, window_radius, number_of_threads);
+        if(do_refit) {
+            refit(number_of_training_images, &argv[training_images_index_from], &argv[label_images_index_from], forest_file, (refit_json_file != NULL ? refit_json_file : forest_file), !refit_replace_counts, number_of_threads, cache_file);
+            return 0;
+        }
+
+        training(number_of_training_images, &argv[training_images_index_from], &argv[label_images_index_from], forest_file, forest_size, max_tree_depth, testobject_tries, window_radius, number_of_threads, copy_sample_windows, (growth_mode == "ebenen" ? 1 : (growth_mode == "beste" ? 2 : (growth_mode == "dschungel" ? 3 : 0))), max_tree_leaves, subsampled_split_scoring, cache_file, warm_start_json_file, resume, first_tree_index, random_seed, out_of_core, time_budget, out_of_bag_fraction, deduplicate_samples, augmentation_variants, augmentation_flips, augmentation_max_angle, augmentation_max_gain, offset_pool_size, (model_type == "farne" ? 1 : 0), jungle_width);
 
     } else {
 
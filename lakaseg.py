@@ -31,7 +31,27 @@ def trainieren(training_data, target_json_file,
                max_tree_depth=3,
                testobject_tries=600,
                window_size=9,
-               number_of_threads=0):
+               number_of_threads=0,
+               copy_sample_windows=False,
+               growth_mode="tiefe",
+               max_tree_leaves=0,
+               subsampled_split_scoring=False,
+               cache_file=None,
+               warm_start_json_file=None,
+               resume=False,
+               first_tree_index=0,
+               random_seed=0,
+               out_of_core=False,
+               time_budget=0,
+               out_of_bag_fraction=0,
+               deduplicate_samples=False,
+               augmentation_variants=0,
+               augmentation_flips=False,
+               augmentation_max_angle=0,
+               augmentation_max_gain=0,
+               offset_pool_size=0,
+               model_type="baeume",
+               jungle_width=64):
     """
     training_data: entweder ein Tupel (trainingsbild.png, labels.png) oder
     eine Liste [(trainingsbild1.png, labels1.png), (trainingsbild2.png,
@@ -60,6 +80,116 @@ def trainieren(training_data, target_json_file,
     number_of_threads: mit OpenMP parallelisieren. Der Wert 1 schaltet die
     Parallelisierung aus, > 1 spezifiziert die Anzahl der Threads, 0 lässt
     OpenMP automatisch die Anzahl von Threads wählen.
+
+    copy_sample_windows: wenn True, wird beim Training das Fenster um jedes
+    Trainingspixel in einen zusammenhängenden Puffer kopiert. Das Training
+    wird dadurch schneller, braucht aber mehr Speicher.
+
+    growth_mode: wie die Entscheidungsbäume wachsen. Entweder "tiefe" (Knoten
+    für Knoten), "ebenen" (Ebene für Ebene, mit einem gemeinsamen
+    Durchlauf über die Trainingsbeispiele pro Ebene, der mit
+    number_of_threads parallelisiert wird), "beste" (immer der Knoten
+    zuerst, der die Entropie am stärksten verringert) oder "dschungel"
+    (Ebene für Ebene, wobei mehrere Knoten einer Ebene dasselbe Kind haben
+    können, siehe jungle_width).
+
+    max_tree_leaves: bei growth_mode "beste" die höchste Anzahl von Blättern
+    pro Baum. Damit sind die Größe der Bäume und die Dauer der Inferenz
+    begrenzt. 0 heißt unbegrenzt, dann begrenzt nur max_tree_depth.
+
+    subsampled_split_scoring: wenn True, werden die Testobjekte in großen
+    Knoten zuerst auf einer wachsenden Stichprobe der Trainingsbeispiele
+    bewertet und nur die, die nach Konfidenzintervallen noch das beste sein
+    können, auf allen Beispielen. Bei großen Bildern spart das etwa ein
+    Viertel der Trainingszeit; die gelernten Bäume sind aber nicht mehr
+    genau dieselben.
+
+    cache_file: Dateiname für einen Trainings-Cache (oder None). Darin werden
+    die gelesenen Trainings- und Labelbilder zwischengespeichert. Bei einem
+    weiteren Training mit denselben Bildern und derselben Fenstergröße werden
+    sie dann von dort gelesen, statt die Bilder neu zu dekodieren.
+
+    warm_start_json_file: Dateiname eines schon trainierten Random Forests
+    (oder None). Der Wald wird geladen und um neue Bäume ergänzt, bis er
+    forest_size Bäume hat, und dann in target_json_file gespeichert. Er muss
+    mit derselben Fenstergröße, max_tree_depth, testobject_tries und
+    denselben Labelfarben trainiert worden sein, mit offset_pool_size auch
+    mit einem Offset-Pool dieser Größe.
+
+    resume: Während des Trainings wird jeder fertige Baum sofort in die Datei
+    target_json_file + ".baeume" geschrieben. Bricht das Training ab, setzt
+    es mit resume=True (und sonst denselben Argumenten) nach dem letzten
+    fertigen Baum fort.
+
+    first_tree_index, random_seed: um einen Wald auf mehreren Rechnern oder in
+    mehreren Prozessen zu trainieren, trainiert jeder Prozess einen Teilwald
+    mit forest_size Bäumen. first_tree_index ist der Index seines ersten
+    Baums, z.B. 0, 10, 20, ... bei je 10 Bäumen. Jeder Baum bekommt einen
+    eigenen Zufallsgenerator, dessen Startwert aus random_seed und seinem
+    Index im ganzen Wald berechnet wird. Alle Teilwälder sollten also
+    denselben random_seed haben; zusammen ergeben sie dann dieselben Bäume
+    wie ein einziges Training mit diesem random_seed (unabhängig von der
+    Anzahl der Threads). Die Teilwälder fügt man danach mit zusammenfuegen()
+    zusammen.
+
+    out_of_core: wenn True, werden die Trainingsdaten ausgelagert, damit mehr
+    davon verarbeitet werden können, als in den Arbeitsspeicher passen. Die
+    Trainingsbilder werden dann direkt aus dem Trainings-Cache (cache_file
+    muss angegeben sein) und die Trainingsbeispiele, ihre Fenster und die
+    Zwischenspeicher des Trainings aus temporären Dateien daneben in den
+    Speicher abgebildet. Nur mit deduplicate braucht jeder Baum beim
+    Zusammenfassen kurz 24 Byte Arbeitsspeicher pro Trainingsbeispiel.
+
+    time_budget: die Zeit in Sekunden, die das Training höchstens dauern soll
+    (oder 0 für unbegrenzt). Nach jedem fertigen Baum wird mit der mittleren
+    Dauer geschätzt, wie viele noch hineinpassen; notfalls werden für die
+    übrigen Bäume testobject_tries verringert (höchstens auf ein Viertel) und
+    weniger als forest_size Bäume trainiert. Ist die Zeit um, werden auch
+    die Bäume, die gerade wachsen, mit Blättern abgeschlossen und der Wald
+    wird gespeichert.
+
+    out_of_bag_fraction: wenn größer als 0, sieht jeder Baum diesen Anteil
+    der Vordergrundpixel (und die nicht ausgewählten Hintergrundpixel) beim
+    Training nicht. Auf diesen Pixeln wird ein F-Maß geschätzt und mit der
+    Konfusionsmatrix in den Lernparametern der JSON-Datei gespeichert
+    ("Out-of-bag F-measure"), ohne eigene Inferenz auf Validierungsbildern.
+    Die Ergebnisse werden dabei pro Pixelklasse (Vordergrund, Band um den
+    Vordergrund, übriger Hintergrund) auf die Anzahl aller gelabelten Pixel
+    dieser Klasse hochgerechnet.
+
+    deduplicate_samples: wenn True, werden Trainingsbeispiele mit gleichem
+    Fenster und Label (z.B. auf leerem Papier) zu einem Beispiel mit Gewicht
+    zusammengefasst. Die gelernten Bäume ändern sich dadurch nicht, aber das
+    Training wird auf Bildern mit großen einheitlichen Flächen schneller.
+
+    augmentation_variants: wenn größer als 1 (höchstens 16), werden die
+    Trainingsbeispiele jedes Baums zufällig auf so viele Varianten verteilt,
+    die (außer der ersten) mit augmentation_flips gespiegelt, um bis zu
+    augmentation_max_angle Grad gedreht und im Kontrast um einen Faktor
+    zwischen 1 - augmentation_max_gain und 1 + augmentation_max_gain verändert
+    sind. Das macht die Bäume robuster gegen schief eingescannte oder anders
+    belichtete Karten, ohne veränderte Kopien der Trainingsbilder anzulegen.
+
+    offset_pool_size: wenn größer als 0 (höchstens 32767), nehmen alle Bäume
+    ihre Pixelpaare aus einem gemeinsamen Pool mit so vielen Paaren, der im
+    Modell gespeichert wird. Bei der Inferenz wird dann jede Differenz nur
+    einmal pro Pixel berechnet und von allen Bäumen geteilt. Mit 64 Paaren
+    werden die Bäume meist kaum schlechter, die Inferenz aber schneller.
+
+    model_type: entweder "baeume" (Entscheidungsbäume) oder "farne" (Random
+    Ferns). Ein Farn ist eine feste Folge von max_tree_depth (höchstens 20)
+    zufälligen Testobjekten, deren Ergebnisse einen Index in eine Tabelle
+    ergeben. Farne werden viel schneller trainiert und ausgewertet, sind aber
+    meist ungenauer. growth_mode, max_tree_leaves, subsampled_split_scoring,
+    copy_sample_windows, deduplicate_samples, augmentation_variants,
+    time_budget, warm_start_json_file, resume und out_of_bag_fraction gibt
+    es nur für Bäume; werden sie für Farne gesetzt, bricht das Training mit
+    einem Fehler ab.
+
+    jungle_width: bei growth_mode "dschungel" die höchste Anzahl von Knoten
+    pro Ebene (mindestens 2). Weil sich Knoten ihre Kinder teilen, wächst
+    ein solcher Baum (ein Entscheidungsdschungel) nicht exponentiell mit der
+    Tiefe und braucht viel weniger Speicher.
     """
 
     if window_size < 1 or window_size % 2 != 1:
@@ -68,6 +198,8 @@ def trainieren(training_data, target_json_file,
         exit(1)
     window_radius = (window_size - 1) // 2
 
+    gm = {"ebenen": 1, "beste": 2, "dschungel": 3}.get(growth_mode, 0)
+
     if isinstance(training_data, tuple):
         training_data = [training_data]
 
@@ -82,7 +214,107 @@ def trainieren(training_data, target_json_file,
     lakaseg_lib.training(
         len(training_data), training_images_array, label_images_array,
         ctypes.c_char_p(encode_str(target_json_file)), forest_size,
-        max_tree_depth, testobject_tries, window_radius, number_of_threads)
+        max_tree_depth, testobject_tries, window_radius, number_of_threads,
+        int(copy_sample_windows), gm, max_tree_leaves,
+        int(subsampled_split_scoring),
+        None if cache_file is None else ctypes.c_char_p(encode_str(cache_file)),
+        None if warm_start_json_file is None else ctypes.c_char_p(
+            encode_str(warm_start_json_file)),
+        int(resume), first_tree_index, random_seed, int(out_of_core),
+        ctypes.c_double(time_budget), ctypes.c_double(out_of_bag_fraction),
+        int(deduplicate_samples), augmentation_variants,
+        int(augmentation_flips), ctypes.c_double(augmentation_max_angle),
+        ctypes.c_double(augmentation_max_gain), offset_pool_size,
+        1 if model_type == "farne" else 0, jungle_width)
+
+
+def nachtrainieren(training_data, json_file, target_json_file=None,
+                   keep_counts=True,
+                   number_of_threads=0,
+                   cache_file=None):
+    """
+    Passt die Blätter eines schon trainierten Random Forests an neue
+    Labelbilder an, ohne die Bäume neu zu lernen. Das geht etwa so schnell
+    wie eine Segmentierung der Trainingsbilder.
+
+    training_data: wie bei trainieren()
+
+    json_file: Pfad zur JSON-Datei mit dem trainierten Random Forest
+
+    target_json_file: Dateiname für den angepassten Random Forest. Bei None
+    wird json_file überschrieben.
+
+    keep_counts: bei True werden die neuen Pixel zu denen aus dem bisherigen
+    Training dazugezählt, bei False ersetzen sie sie. Jeder Baum zählt
+    dieselben Hintergrundpixel wie beim Training; mit den Trainingsbildern
+    und False kommen also wieder die Anzahlen aus dem Training heraus (bei
+    einem Wald, der mit einem Thread trainiert wurde).
+
+    number_of_threads, cache_file: wie bei trainieren()
+    """
+
+    if isinstance(training_data, tuple):
+        training_data = [training_data]
+
+    if not json_file.endswith(".json"):
+        json_file += ".json"
+    if target_json_file is None:
+        target_json_file = json_file
+    if not target_json_file.endswith(".json"):
+        target_json_file += ".json"
+
+    training_images_array = (ctypes.c_char_p * len(training_data))()
+    training_images_array[:] = [encode_str(ti) for (ti, li) in training_data]
+    label_images_array = (ctypes.c_char_p * len(training_data))()
+    label_images_array[:] = [encode_str(li) for (ti, li) in training_data]
+
+    lakaseg_lib.refit(
+        len(training_data), training_images_array, label_images_array,
+        ctypes.c_char_p(encode_str(json_file)),
+        ctypes.c_char_p(encode_str(target_json_file)), int(keep_counts),
+        number_of_threads,
+        None if cache_file is None else ctypes.c_char_p(encode_str(cache_file)))
+
+
+def abschneiden(json_file, target_json_file, max_tree_depth):
+    """
+    Schneidet alle Bäume eines trainierten Random Forests auf die Tiefe
+    max_tree_depth ab und speichert das Ergebnis in target_json_file. Das geht
+    viel schneller als ein neues Training. Man kann also einmal mit großer
+    Tiefe trainieren und dann verschiedene Tiefen ausprobieren.
+    """
+
+    if not json_file.endswith(".json"):
+        json_file += ".json"
+    if not target_json_file.endswith(".json"):
+        target_json_file += ".json"
+
+    lakaseg_lib.truncate_forest(
+        ctypes.c_char_p(encode_str(json_file)),
+        ctypes.c_char_p(encode_str(target_json_file)), max_tree_depth)
+
+
+def zusammenfuegen(json_files, target_json_file):
+    """
+    Fügt mehrere Random Forests (z.B. Teilwälder, die mit first_tree_index
+    und random_seed getrennt trainiert wurden) zu einem zusammen. Sie müssen
+    dieselbe Fenstergröße, Tiefe, Anzahl der Versuche und dieselben
+    Labelfarben haben. Teilwälder mit demselben random_seed, deren Indizes
+    sich überschneiden, und doppelte Bäume werden abgelehnt.
+
+    json_files: Liste mit den Pfaden der JSON-Dateien
+
+    target_json_file: Dateiname für den zusammengefügten Wald
+    """
+
+    if not target_json_file.endswith(".json"):
+        target_json_file += ".json"
+
+    json_files_array = (ctypes.c_char_p * len(json_files))()
+    json_files_array[:] = [encode_str(f) for f in json_files]
+
+    lakaseg_lib.merge_forests(len(json_files), json_files_array,
+                              ctypes.c_char_p(encode_str(target_json_file)))
 
 
 def segmentieren(input_image, json_file, result_image,
@@ -118,6 +350,11 @@ def segmentieren(input_image, json_file, result_image,
     das Eingabebild. Es wird mit dem Segmentierungsergebnis verglichen und das
     Ergebnis als F-Maß in eine Datei geschrieben. Eventuell nützlich um die
     Leistung zu testen. Bei None wird nichts dergleichen gemacht.
+
+    segmentieren kann gleichzeitig aus mehreren Threads aufgerufen werden,
+    auch mit verschiedenen Wäldern. Die Ergebnisse sind dieselben wie
+    nacheinander. Das gilt nicht für ground_truth_image, weil dann alle in
+    dieselbe Datei schreiben.
     """
 
     if result_image is not None and "." not in result_image:
@@ -0,0 +1,261 @@
+# -*- coding: utf-8 -*-
+"""
+Kleiner Ende-zu-Ende-Test für die Kommandozeile: trainiert auf zwei
+erzeugten Bildern einen Wald in Teilwäldern und prüft, dass er nach
+'zusammenfuegen' dieselben Bäume hat wie ein einziges Training. Genauso für
+einen Wald, der mit -a um weitere Bäume ergänzt wird, und für die
+Optionen, die nur ändern, wie die Trainingsbeispiele gespeichert werden.
+Dazu kommen 'abschneiden' und 'nachtrainieren' eines trainierten Walds.
+
+Aufruf mit 'make check' oder 'python3 tests/smoke_test.py [pfad/zu/lakaseg]'
+"""
+
+from __future__ import print_function
+
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+LAKASEG = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else
+                          os.path.join(os.path.dirname(__file__), "..", "lakaseg"))
+
+WIDTH = 96
+HEIGHT = 72
+
+
+def write_pgm(filename, pixels):
+    with open(filename, "wb") as f:
+        f.write(("P5\n%d %d\n255\n" % (WIDTH, HEIGHT)).encode("ascii"))
+        f.write(bytearray(pixels))
+
+
+def make_images(directory, number, seed):
+    """
+    Eine "Karte" mit dunklen Linien auf verrauschtem Papier und das
+    Labelbild dazu (Linien 255, Papier 100, der Rand ohne Label). Das
+    rechte Viertel ist eine glatte dunkle Fläche, die wie die Linien zählt;
+    dort sind viele Fenster gleich (für -y).
+    """
+
+    state = [seed]
+
+    def rand(n):
+        state[0] = (state[0] * 1103515245 + 12345) & 0x7fffffff
+        return (state[0] >> 8) % n
+
+    image = []
+    labels = []
+    for y in range(HEIGHT):
+        for x in range(WIDTH):
+            if x >= WIDTH * 3 // 4:
+                line = True
+                image.append(60)
+            else:
+                line = (x + 2*y + 3*number) % 17 < 2 or (3*x - y) % 23 == 0
+                image.append((40 if line else 200) + rand(40))
+            if x < 4 or y < 4 or x >= WIDTH - 4 or y >= HEIGHT - 4:
+                labels.append(0)
+            else:
+                labels.append(255 if line else 100)
+
+    image_file = os.path.join(directory, "karte%d.pgm" % number)
+    label_file = os.path.join(directory, "karte%d_labels.pgm" % number)
+    write_pgm(image_file, image)
+    write_pgm(label_file, labels)
+    return image_file, label_file
+
+
+def lakaseg(*args, **kwargs):
+    process = subprocess.Popen([LAKASEG] + list(args), stdout=subprocess.PIPE,
+                               stderr=subprocess.PIPE)
+    out, err = process.communicate()
+    if (process.returncode == 0) != kwargs.get("succeed", True):
+        print(" ".join(args), file=sys.stderr)
+        print(out.decode("utf-8", "replace"), file=sys.stderr)
+        print(err.decode("utf-8", "replace"), file=sys.stderr)
+        raise AssertionError("lakaseg hat mit %d geendet" % process.returncode)
+
+
+def load_trees(filename):
+    # [Parameter, Hintergrundfarbe, Vordergrundfarbe, Baum, Baum, ...]
+    with open(filename) as f:
+        forest = json.load(f)
+    return forest[0], sorted(json.dumps(tree, sort_keys=True) for tree in forest[3:])
+
+
+def test_merge(directory, images, labels):
+    training = ["training", "-i"] + images + ["-l"] + labels + \
+               ["-d", "5", "-p", "30", "-z", "17"]
+    whole = os.path.join(directory, "ganz.json")
+    parts = [os.path.join(directory, "teil%d.json" % i) for i in range(2)]
+    merged = os.path.join(directory, "zusammen.json")
+
+    lakaseg(*(training + ["-t", "4", "-o", "2", "-f", whole]))
+    lakaseg(*(training + ["-t", "3", "-x", "0", "-o", "1", "-f", parts[0]]))
+    lakaseg(*(training + ["-t", "1", "-x", "3", "-o", "2", "-f", parts[1]]))
+    lakaseg(*(["zusammenfuegen", "-i"] + parts + ["-f", merged]))
+
+    parameters, trees = load_trees(merged)
+    assert parameters["Forest size"] == 4, parameters
+    assert len(trees) == 4
+    assert trees == load_trees(whole)[1], \
+        "Die zusammengefügten Teilwälder haben andere Bäume als ein ganzer Wald"
+    assert parameters["Random seed"] == 17 and parameters["First tree index"] == 0, parameters
+
+    # derselbe Teilwald zweimal, überlappende Indizes und eine andere Tiefe
+    # passen nicht zusammen
+    lakaseg("zusammenfuegen", "-i", parts[0], parts[0], "-f", merged, succeed=False)
+    overlapping = os.path.join(directory, "ueberlappend.json")
+    lakaseg(*(training + ["-t", "2", "-x", "2", "-o", "1", "-f", overlapping]))
+    lakaseg("zusammenfuegen", "-i", parts[0], overlapping, "-f", merged, succeed=False)
+    deeper = os.path.join(directory, "tiefer.json")
+    deeper_training = list(training)
+    deeper_training[deeper_training.index("-d") + 1] = "6"
+    lakaseg(*(deeper_training + ["-t", "1", "-x", "3", "-o", "1", "-f", deeper]))
+    lakaseg("zusammenfuegen", "-i", parts[0], deeper, "-f", merged, succeed=False)
+
+    # mit einem anderen Startwert sind es andere Bäume, der Wald hat dann
+    # aber keine Herkunft mehr
+    other_seed = os.path.join(directory, "anderer_startwert.json")
+    other_training = list(training)
+    other_training[other_training.index("-z") + 1] = "18"
+    lakaseg(*(other_training + ["-t", "1", "-o", "1", "-f", other_seed]))
+    lakaseg("zusammenfuegen", "-i", parts[0], other_seed, "-f", merged)
+    parameters, trees = load_trees(merged)
+    assert len(trees) == 4 and "Random seed" not in parameters, parameters
+
+
+def test_warm_start(directory, images, labels):
+    training = ["training", "-i"] + images + ["-l"] + labels + \
+               ["-d", "5", "-p", "30", "-z", "23", "-P", "16", "-o", "2"]
+    whole = os.path.join(directory, "ganz_pool.json")
+    old = os.path.join(directory, "alt.json")
+    extended = os.path.join(directory, "ergaenzt.json")
+
+    lakaseg(*(training + ["-t", "4", "-f", whole]))
+    lakaseg(*(training + ["-t", "2", "-f", old]))
+    lakaseg(*(training + ["-t", "4", "-a", old, "-f", extended]))
+
+    parameters, trees = load_trees(extended)
+    whole_parameters, whole_trees = load_trees(whole)
+    assert parameters["Forest size"] == 4, parameters
+    assert parameters["Offset pool"] == load_trees(old)[0]["Offset pool"], \
+        "Die neuen Bäume nehmen ihre Offsets nicht aus dem Pool des alten Walds"
+    assert parameters["Offset pool"] == whole_parameters["Offset pool"]
+    assert trees == whole_trees, \
+        "Der ergänzte Wald hat andere Bäume als ein ganzer Wald"
+
+    # ein Wald mit anderer Tiefe passt nicht zum Kopf des alten Walds
+    deeper = list(training)
+    deeper[deeper.index("-d") + 1] = "6"
+    lakaseg(*(deeper + ["-t", "4", "-a", old, "-f", extended]), succeed=False)
+
+    # genauso ein Pool mit anderer Größe oder ein alter Wald ohne Pool
+    bigger_pool = list(training)
+    bigger_pool[bigger_pool.index("-P") + 1] = "32"
+    lakaseg(*(bigger_pool + ["-t", "4", "-a", old, "-f", extended]), succeed=False)
+    without_pool = os.path.join(directory, "ohne_pool.json")
+    no_pool = list(training)
+    del no_pool[no_pool.index("-P"):no_pool.index("-P") + 2]
+    lakaseg(*(no_pool + ["-t", "2", "-f", without_pool]))
+    lakaseg(*(training + ["-t", "4", "-a", without_pool, "-f", extended]), succeed=False)
+
+
+def test_sample_storage(directory, images, labels):
+    # kopierte Fenster, Zusammenfassen, der Trainings-Cache und das
+    # Auslagern ändern nur, wie die Trainingsbeispiele gespeichert werden,
+    # nicht die gelernten Bäume
+    cache = os.path.join(directory, "cache.bin")
+    variants = [["-s"], ["-y"], ["-s", "-y"], ["-c", cache], ["-c", cache, "-q"]]
+    for growth_mode in ("tiefe", "ebenen", "beste", "dschungel"):
+        training = ["training", "-i"] + images + ["-l"] + labels + \
+                   ["-d", "5", "-p", "30", "-t", "2", "-o", "2", "-z", "29", "-g", growth_mode]
+        plain = os.path.join(directory, "einfach_%s.json" % growth_mode)
+        lakaseg(*(training + ["-f", plain]))
+        plain_trees = load_trees(plain)[1]
+
+        for options in variants:
+            forest = os.path.join(directory, "variante.json")
+            lakaseg(*(training + options + ["-f", forest]))
+            assert load_trees(forest)[1] == plain_trees, \
+                "Mit -g %s und %s gibt es andere Bäume" % (growth_mode, " ".join(options))
+
+
+def leaf_counts(node):
+    """
+    Vordergrund- und Gesamtzahl eines Blatts bzw. die Summen über die
+    Blätter unter einem inneren Knoten ([Test, links, rechts, Anzahlen])
+    """
+    if not isinstance(node, list):
+        return 0, 0
+    if isinstance(node[0], list):
+        left = leaf_counts(node[1])
+        right = leaf_counts(node[2])
+        return left[0] + right[0], left[1] + right[1]
+    return node[0], node[1]
+
+
+def check_truncated(original, truncated, depth, max_depth):
+    is_inner = isinstance(original, list) and isinstance(original[0], list)
+    if not is_inner or depth < max_depth:
+        assert original == truncated or (is_inner and original[0] == truncated[0])
+        if is_inner:
+            check_truncated(original[1], truncated[1], depth + 1, max_depth)
+            check_truncated(original[2], truncated[2], depth + 1, max_depth)
+        return
+    assert list(leaf_counts(original)) == truncated, \
+        "Ein abgeschnittenes Blatt hat %s statt der Summe %s" % (truncated, leaf_counts(original))
+
+
+def test_truncate_and_refit(directory, images, labels):
+    forest = os.path.join(directory, "tief.json")
+    result = os.path.join(directory, "ergebnis.json")
+    lakaseg(*(["training", "-i"] + images + ["-l"] + labels +
+              ["-d", "6", "-p", "30", "-t", "3", "-o", "1", "-z", "31", "-f", forest]))
+    with open(forest) as f:
+        trees = json.load(f)[3:]
+
+    # auf die trainierte Tiefe oder tiefer abschneiden ändert nichts
+    for depth in ("6", "9"):
+        lakaseg("abschneiden", "-f", forest, "-d", depth, "-n", result)
+        assert load_trees(result)[1] == load_trees(forest)[1], \
+            "Abschneiden auf Tiefe %s hat die Bäume geändert" % depth
+
+    # die neuen Blätter haben zusammen, was darunter gezählt wurde
+    lakaseg("abschneiden", "-f", forest, "-d", "3", "-n", result)
+    with open(result) as f:
+        truncated_trees = json.load(f)[3:]
+    for tree, truncated in zip(trees, truncated_trees):
+        check_truncated(tree, truncated, 0, 3)
+
+    # mit denselben Bildern nur neu gezählt kommen dieselben Anzahlen heraus
+    lakaseg(*(["nachtrainieren", "-i"] + images + ["-l"] + labels +
+              ["-f", forest, "-n", result, "-k"]))
+    assert load_trees(result)[1] == load_trees(forest)[1], \
+        "Nachtrainieren auf den Trainingsbildern hat andere Anzahlen gezählt"
+
+
+def main():
+    if not os.path.exists(LAKASEG):
+        print("Fehler: %s gibt es nicht, zuerst 'make bin'" % LAKASEG, file=sys.stderr)
+        return 1
+
+    directory = tempfile.mkdtemp(prefix="lakaseg_test_")
+    try:
+        images, labels = zip(*[make_images(directory, i, 1 + i) for i in range(2)])
+        images, labels = list(images), list(labels)
+
+        for test in (test_merge, test_warm_start, test_sample_storage, test_truncate_and_refit):
+            test(directory, images, labels)
+            print("%s: ok" % test.__name__)
+    finally:
+        shutil.rmtree(directory)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())